@@ -0,0 +1,127 @@
+// Yaw only oriented bounding boxes in a single streaming pass over the cluster points.
+// The extents along OBB_YAW_STEPS candidate yaws are tracked together and the yaw with the
+// smallest footprint wins, the minimum area rectangle rotating calipers would find on the
+// hull up to the angular step, without building the hull or keeping any point.
+
+#ifndef ORIENTED_BOX_H
+#define ORIENTED_BOX_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "../cluster/clusterSet.h"
+
+// candidate yaws over [0, 90) degrees, a rectangle repeats every quarter turn
+#define OBB_YAW_STEPS 32
+// frames with fewer clustered points are fitted on the calling thread
+#define OBB_PARALLEL_POINTS 20000
+
+struct OrientedBox
+{
+	// center
+	float x, y, z;
+	// along the yaw, across it and vertical, length >= width
+	float length, width, height;
+	// rotation about z in radians
+	float yaw;
+};
+
+struct OrientedBoxFit
+{
+	float cosYaw[OBB_YAW_STEPS];
+	float sinYaw[OBB_YAW_STEPS];
+	int numThreads;
+
+	OrientedBoxFit()
+	: numThreads(std::max(1u, std::thread::hardware_concurrency()))
+	{
+		for(int k = 0; k < OBB_YAW_STEPS; k++)
+		{
+			cosYaw[k] = cos(k * M_PI/2 / OBB_YAW_STEPS);
+			sinYaw[k] = sin(k * M_PI/2 / OBB_YAW_STEPS);
+		}
+	}
+
+	// begin, end: any range of PCL-like points
+	template<typename PointT>
+	OrientedBox fit(const PointT *begin, const PointT *end) const
+	{
+		float minU[OBB_YAW_STEPS], maxU[OBB_YAW_STEPS], minV[OBB_YAW_STEPS], maxV[OBB_YAW_STEPS];
+		std::fill(minU, minU + OBB_YAW_STEPS, std::numeric_limits<float>::max());
+		std::fill(minV, minV + OBB_YAW_STEPS, std::numeric_limits<float>::max());
+		std::fill(maxU, maxU + OBB_YAW_STEPS, -std::numeric_limits<float>::max());
+		std::fill(maxV, maxV + OBB_YAW_STEPS, -std::numeric_limits<float>::max());
+		float minZ = std::numeric_limits<float>::max(), maxZ = -std::numeric_limits<float>::max();
+
+		// one pass, the inner loop over yaws has no dependencies and vectorizes
+		for(const PointT *point = begin; point != end; point++)
+		{
+			float x = point->x, y = point->y;
+			for(int k = 0; k < OBB_YAW_STEPS; k++)
+			{
+				float u = x*cosYaw[k] + y*sinYaw[k];
+				float v = y*cosYaw[k] - x*sinYaw[k];
+				minU[k] = std::min(minU[k], u);
+				maxU[k] = std::max(maxU[k], u);
+				minV[k] = std::min(minV[k], v);
+				maxV[k] = std::max(maxV[k], v);
+			}
+			minZ = std::min(minZ, point->z);
+			maxZ = std::max(maxZ, point->z);
+		}
+
+		OrientedBox box;
+		if(begin == end)
+		{
+			box.x = box.y = box.z = box.length = box.width = box.height = box.yaw = 0;
+			return box;
+		}
+
+		int best = 0;
+		for(int k = 1; k < OBB_YAW_STEPS; k++)
+			if((maxU[k]-minU[k])*(maxV[k]-minV[k]) < (maxU[best]-minU[best])*(maxV[best]-minV[best]))
+				best = k;
+
+		// center back from the box frame to the world frame
+		float centerU = (minU[best] + maxU[best]) / 2, centerV = (minV[best] + maxV[best]) / 2;
+		box.x = centerU*cosYaw[best] - centerV*sinYaw[best];
+		box.y = centerU*sinYaw[best] + centerV*cosYaw[best];
+		box.z = (minZ + maxZ) / 2;
+		box.length = maxU[best] - minU[best];
+		box.width = maxV[best] - minV[best];
+		box.height = maxZ - minZ;
+		box.yaw = best * M_PI/2 / OBB_YAW_STEPS;
+		if(box.width > box.length)
+		{
+			std::swap(box.length, box.width);
+			box.yaw += M_PI/2;
+		}
+		return box;
+	}
+
+	// Boxes of every cluster, clusters are handed out one at a time so big and small ones balance across threads
+	template<typename PointT>
+	void fit(const ClusterSet<PointT> &clusters, std::vector<OrientedBox> &boxes) const
+	{
+		boxes.resize(clusters.size());
+		std::atomic<int> nextCluster(0);
+		auto worker = [&]()
+		{
+			for(int cluster = nextCluster++; cluster < clusters.size(); cluster = nextCluster++)
+				boxes[cluster] = fit(clusters.begin(cluster), clusters.end(cluster));
+		};
+
+		int threadsUsed = clusters.points.size() < OBB_PARALLEL_POINTS ? 1 : std::min(numThreads, clusters.size());
+		std::vector<std::thread> threads;
+		for(int t = 1; t < threadsUsed; t++)
+			threads.push_back(std::thread(worker));
+		worker();
+		for(std::thread &thread : threads)
+			thread.join();
+	}
+};
+
+#endif /* ORIENTED_BOX_H */
@@ -0,0 +1,51 @@
+// Timing of the VoxelGrid -> CropBox -> ExtractIndices chain of FilterCloud
+// against the single pass FilterCloudFused on a recorded pcd stream
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include <string>
+
+#define GRID_SIZE 0.4
+
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchFilterCloud [dataPath]
+    std::string dataPath = (argc > 1) ? argv[1] : "../src/sensors/data/pcd/data_2";
+    // Same region as cityBlock()
+    Eigen::Vector4f minPoint(-10, -5, -2, 1);
+    Eigen::Vector4f maxPoint(30, 8, 1, 1);
+
+    ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+    std::vector<boost::filesystem::path> stream = pointProcessor.streamPcd(dataPath);
+
+    double chainMs = 0, fusedMs = 0;
+    long inputPoints = 0, chainPoints = 0, fusedPoints = 0;
+    for(const boost::filesystem::path& file : stream)
+    {
+        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = pointProcessor.loadPcd(file.string());
+        inputPoints += cloud->points.size();
+
+        auto startTime = std::chrono::steady_clock::now();
+        pcl::PointCloud<pcl::PointXYZI>::Ptr chainCloud = pointProcessor.FilterCloud(cloud, GRID_SIZE, minPoint, maxPoint);
+        chainMs += elapsedMs(startTime);
+        chainPoints += chainCloud->points.size();
+
+        startTime = std::chrono::steady_clock::now();
+        pcl::PointCloud<pcl::PointXYZI>::Ptr fusedCloud = pointProcessor.FilterCloudFused(cloud, GRID_SIZE, minPoint, maxPoint);
+        fusedMs += elapsedMs(startTime);
+        fusedPoints += fusedCloud->points.size();
+    }
+
+    int frames = std::max<int>(stream.size(), 1);
+    std::cout << dataPath << " (" << stream.size() << " frames, " << inputPoints/frames << " points/frame, leaf " << GRID_SIZE << ")" << std::endl;
+    std::cout << "  FilterCloud       " << chainMs/frames << " ms/frame, " << chainPoints/frames << " points/frame out" << std::endl;
+    std::cout << "  FilterCloudFused  " << fusedMs/frames << " ms/frame, " << fusedPoints/frames << " points/frame out (roof removed)" << std::endl;
+}
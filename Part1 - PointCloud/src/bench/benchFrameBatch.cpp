@@ -0,0 +1,71 @@
+// Throughput of FrameBatch running the cityBlock chain (filter, segment, cluster, box)
+// over a recorded pcd stream with 1, 2, 4, ... up to all cores
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include "../pipeline/frameBatch.h"
+#include <string>
+#include <thread>
+
+// Same parameters as cityBlock in environment.cpp
+#define GRID_SIZE 0.4
+#define SEG_MAX_ITER 30
+#define SEG_THRESHOLD 0.35
+#define CLUSTER_MIN_SIZE 10
+#define CLUSTER_MAX_SIZE 500
+#define CLUSTER_TOLERANCE 0.53
+
+
+void processFrame(ProcessPointClouds<pcl::PointXYZI>& processor, Frame<pcl::PointXYZI>& frame)
+{
+    frame.input = processor.loadPcdMapped(frame.file);
+    frame.filtered = processor.FilterCloud(frame.input, GRID_SIZE, Eigen::Vector4f (-10,-5,-2,1), Eigen::Vector4f (30,8,1,1));
+    frame.segmented = processor.SegmentPlane(frame.filtered, SEG_MAX_ITER, SEG_THRESHOLD, NativeRansac);
+    processor.Clustering(frame.segmented.first, CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, frame.clusters, CustomKdTree);
+    for(int cluster = 0; cluster < frame.clusters.size(); cluster++)
+        frame.boxes.push_back(processor.BoundingBox(frame.clusters, cluster));
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchFrameBatch [dataPath] [maxThreads]
+    std::string dataPath = (argc > 1) ? argv[1] : "../src/sensors/data/pcd/data_2";
+    int maxThreads = (argc > 2) ? std::stoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    ProcessPointClouds<pcl::PointXYZI> streamProcessor;
+    std::vector<boost::filesystem::path> stream = streamProcessor.streamPcd(dataPath);
+
+    std::vector<int> threadCounts;
+    for(int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    std::cout << dataPath << " (" << stream.size() << " frames)" << std::endl;
+    double baseFps = 0;
+    for(int threads : threadCounts)
+    {
+        ThreadPool pool(threads);
+        std::vector<ProcessPointClouds<pcl::PointXYZI>> processors(pool.size());
+        for(ProcessPointClouds<pcl::PointXYZI>& processor : processors)
+        {
+            processor.setVerbose(false);
+            processor.setNumThreads(1);
+        }
+
+        long boxes = 0;
+        auto startTime = std::chrono::steady_clock::now();
+        FrameBatch<pcl::PointXYZI> batch(pool);
+        batch.run(stream,
+            [&processors](int worker, Frame<pcl::PointXYZI>& frame){ processFrame(processors[worker], frame); },
+            [&boxes](Frame<pcl::PointXYZI>& frame){ boxes += frame.boxes.size(); });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        double fps = stream.size()/std::max(seconds, 1e-9);
+        if(threads == 1)
+            baseFps = fps;
+        std::cout << "  " << threads << " threads: " << fps << " frames/s, speedup " << fps/baseFps
+                  << ", efficiency " << 100*fps/baseFps/threads << "%, " << boxes << " boxes" << std::endl;
+    }
+}
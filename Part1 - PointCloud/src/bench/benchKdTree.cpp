@@ -0,0 +1,142 @@
+// Benchmark of the custom KdTree<3> and VoxelHashIndex against pcl::search::KdTree
+// on the recorded pcd streams, timing index build and radius search per frame
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include "../cluster/kdtree.h"
+#include "../cluster/voxelHashIndex.h"
+#include <string>
+
+// Only every QUERY_STRIDE-th point is used as a query to keep full frames fast
+#define QUERY_STRIDE 10
+// Swept when no tolerance is given, CLUSTER_TOLERANCE of environment.cpp is 0.53
+#define DEFAULT_TOLERANCES {0.2f, 0.53f, 1.0f, 2.0f}
+
+
+struct BenchResult
+{
+    double buildMs;
+    double searchMs;
+    long neighbours;
+
+    BenchResult()
+    : buildMs(0), searchMs(0), neighbours(0)
+    {}
+};
+
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+void benchPclTree(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud, float tolerance, BenchResult& result)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    pcl::search::KdTree<pcl::PointXYZI>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZI>);
+    tree->setInputCloud(cloud);
+    result.buildMs += elapsedMs(startTime);
+
+    std::vector<int> nearby;
+    std::vector<float> distances;
+    startTime = std::chrono::steady_clock::now();
+    for(int index = 0; index < (int)cloud->points.size(); index += QUERY_STRIDE)
+        result.neighbours += tree->radiusSearch(index, tolerance, nearby, distances);
+    result.searchMs += elapsedMs(startTime);
+}
+
+
+void benchCustomTree(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud, float tolerance, BenchResult& result)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    KdTree<3> tree;
+    tree.reserve(cloud->points.size());
+    for(int index = 0; index < (int)cloud->points.size(); index++)
+        tree.insert(cloud->points[index].data, index);
+    tree.build();
+    result.buildMs += elapsedMs(startTime);
+
+    std::vector<int> nearby;
+    startTime = std::chrono::steady_clock::now();
+    for(int index = 0; index < (int)cloud->points.size(); index += QUERY_STRIDE)
+    {
+        nearby.clear();
+        tree.search(cloud->points[index].data, tolerance, nearby);
+        result.neighbours += nearby.size();
+    }
+    result.searchMs += elapsedMs(startTime);
+}
+
+
+// Cells as big as the tolerance, like the VoxelHash backend of Clustering
+void benchVoxelHash(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud, float tolerance, VoxelHashIndex<pcl::PointXYZI>& voxelIndex, BenchResult& result)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    voxelIndex.build(cloud->points, tolerance);
+    result.buildMs += elapsedMs(startTime);
+
+    std::vector<int> nearby;
+    startTime = std::chrono::steady_clock::now();
+    for(int index = 0; index < (int)cloud->points.size(); index += QUERY_STRIDE)
+    {
+        nearby.clear();
+        voxelIndex.search(cloud->points[index].data, tolerance, nearby);
+        result.neighbours += nearby.size();
+    }
+    result.searchMs += elapsedMs(startTime);
+}
+
+
+void benchStream(ProcessPointClouds<pcl::PointXYZI>& pointProcessor, const std::string& dataPath, const std::vector<float>& tolerances)
+{
+    std::vector<boost::filesystem::path> stream = pointProcessor.streamPcd(dataPath);
+    std::vector<BenchResult> pclResults(tolerances.size()), customResults(tolerances.size()), voxelResults(tolerances.size());
+    VoxelHashIndex<pcl::PointXYZI> voxelIndex;
+
+    for(const boost::filesystem::path& file : stream)
+    {
+        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = pointProcessor.loadPcd(file.string());
+        for(int t = 0; t < (int)tolerances.size(); t++)
+        {
+            benchPclTree(cloud, tolerances[t], pclResults[t]);
+            benchCustomTree(cloud, tolerances[t], customResults[t]);
+            benchVoxelHash(cloud, tolerances[t], voxelIndex, voxelResults[t]);
+        }
+    }
+
+    int frames = std::max<int>(stream.size(), 1);
+    for(int t = 0; t < (int)tolerances.size(); t++)
+    {
+        std::cout << dataPath << " (" << stream.size() << " frames, tolerance " << tolerances[t] << ")" << std::endl;
+        std::cout << "  pcl::search::KdTree  build " << pclResults[t].buildMs/frames << " ms/frame, search "
+                  << pclResults[t].searchMs/frames << " ms/frame, " << pclResults[t].neighbours << " neighbours" << std::endl;
+        std::cout << "  KdTree<3>            build " << customResults[t].buildMs/frames << " ms/frame, search "
+                  << customResults[t].searchMs/frames << " ms/frame, " << customResults[t].neighbours << " neighbours" << std::endl;
+        std::cout << "  VoxelHashIndex       build " << voxelResults[t].buildMs/frames << " ms/frame, search "
+                  << voxelResults[t].searchMs/frames << " ms/frame, " << voxelResults[t].neighbours << " neighbours" << std::endl;
+
+        if(pclResults[t].neighbours != customResults[t].neighbours || pclResults[t].neighbours != voxelResults[t].neighbours)
+            std::cout << "  WARNING: neighbour counts differ between the indices" << std::endl;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchKdTree [tolerance] [dataPath ...]
+    std::vector<float> tolerances = DEFAULT_TOLERANCES;
+    if(argc > 1)
+        tolerances = {std::stof(argv[1])};
+
+    std::vector<std::string> dataPaths;
+    for(int arg = 2; arg < argc; arg++)
+        dataPaths.push_back(argv[arg]);
+    if(dataPaths.empty())
+        dataPaths = {"../src/sensors/data/pcd/data_1", "../src/sensors/data/pcd/data_2"};
+
+    ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+    for(const std::string& dataPath : dataPaths)
+        benchStream(pointProcessor, dataPath, tolerances);
+}
@@ -0,0 +1,104 @@
+// Frames per second of the pcd loaders on a recorded stream: pcl ascii, pcl binary,
+// the memory mapped PcdReader and replay from a pre-converted PcdStreamIndex
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include <string>
+
+// ascii copies are slow to write, only the first frames are converted
+#define ASCII_FRAMES 10
+
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void printRate(const std::string& name, int frames, long points, double ms)
+{
+    std::cout << "  " << name << (ms > 0 ? 1000.0*frames/ms : 0) << " frames/s, " << (frames ? ms/frames : 0) << " ms/frame, "
+              << (frames ? points/frames : 0) << " points/frame" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchPcdReader [dataPath]...
+    std::vector<std::string> dataPaths;
+    for(int arg = 1; arg < argc; arg++)
+        dataPaths.push_back(argv[arg]);
+    if(dataPaths.empty())
+    {
+        dataPaths.push_back("../src/sensors/data/pcd/data_1");
+        dataPaths.push_back("../src/sensors/data/pcd/data_2");
+    }
+
+    ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+    boost::filesystem::path tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("benchPcdReader-%%%%%%");
+    boost::filesystem::create_directories(tempDir);
+
+    for(const std::string& dataPath : dataPaths)
+    {
+        std::vector<boost::filesystem::path> stream = pointProcessor.streamPcd(dataPath);
+        int frames = stream.size();
+        std::cout << dataPath << " (" << frames << " frames)" << std::endl;
+
+        // pcl::io on the recorded binary files
+        long points = 0;
+        auto startTime = std::chrono::steady_clock::now();
+        for(const boost::filesystem::path& file : stream)
+            points += pointProcessor.loadPcd(file.string())->points.size();
+        printRate("pcl binary     ", frames, points, elapsedMs(startTime));
+
+        // memory mapped reader on the same files
+        points = 0;
+        startTime = std::chrono::steady_clock::now();
+        for(const boost::filesystem::path& file : stream)
+            points += pointProcessor.loadPcdMapped(file.string())->points.size();
+        printRate("mapped binary  ", frames, points, elapsedMs(startTime));
+
+        // replay from the stream index, conversion is a one time cost
+        std::string indexFile = (tempDir / (boost::filesystem::path(dataPath).filename().string() + ".pcdidx")).string();
+        startTime = std::chrono::steady_clock::now();
+        PcdStreamIndex<pcl::PointXYZI>::build(stream, indexFile);
+        double buildMs = elapsedMs(startTime);
+
+        PcdStreamIndex<pcl::PointXYZI> streamIndex;
+        if(streamIndex.open(indexFile))
+        {
+            pcl::PointCloud<pcl::PointXYZI> cloud;
+            points = 0;
+            startTime = std::chrono::steady_clock::now();
+            for(int frame = 0; frame < streamIndex.size(); frame++)
+            {
+                streamIndex.load(frame, cloud);
+                points += cloud.points.size();
+            }
+            printRate("stream index   ", streamIndex.size(), points, elapsedMs(startTime));
+            std::cout << "    (index built in " << buildMs << " ms)" << std::endl;
+        }
+        else
+            std::cerr << "Couldn't open stream index " << indexFile << std::endl;
+
+        // ascii copies of the first frames
+        int asciiFrames = std::min(frames, ASCII_FRAMES);
+        std::vector<std::string> asciiFiles;
+        for(int frame = 0; frame < asciiFrames; frame++)
+        {
+            asciiFiles.push_back((tempDir / stream[frame].filename()).string());
+            pointProcessor.savePcd(pointProcessor.loadPcdMapped(stream[frame].string()), asciiFiles.back(), PcdAscii);
+        }
+        points = 0;
+        startTime = std::chrono::steady_clock::now();
+        for(const std::string& file : asciiFiles)
+            points += pointProcessor.loadPcd(file)->points.size();
+        printRate("pcl ascii      ", asciiFrames, points, elapsedMs(startTime));
+
+        boost::filesystem::remove(indexFile);
+        for(const std::string& file : asciiFiles)
+            boost::filesystem::remove(file);
+    }
+
+    boost::filesystem::remove_all(tempDir);
+}
@@ -0,0 +1,75 @@
+// Latency of SegmentPlane with pcl::SACSegmentation against the native
+// multithreaded RANSAC on a recorded pcd stream. Also checks that the native
+// RANSAC finds the same plane on one thread as on several.
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include <string>
+#include <thread>
+
+#define SEG_MAX_ITER 30
+#define SEG_THRESHOLD 0.35
+// threads the single threaded fit is compared with, at least this many even on fewer cores
+#define DETERMINISM_THREADS 4
+
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchSegmentPlane [dataPath]
+    std::string dataPath = (argc > 1) ? argv[1] : "../src/sensors/data/pcd/data_1";
+
+    ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+    std::vector<boost::filesystem::path> stream = pointProcessor.streamPcd(dataPath);
+
+    double pclMs = 0, nativeMs = 0, pclWorstMs = 0, nativeWorstMs = 0;
+    long pclRoad = 0, nativeRoad = 0;
+    RansacPlane serialRansac, threadedRansac;
+    serialRansac.numThreads = 1;
+    threadedRansac.numThreads = std::max<int>(DETERMINISM_THREADS, std::thread::hardware_concurrency());
+    std::vector<int> serialInliers, threadedInliers;
+    int differentFrames = 0;
+    for(const boost::filesystem::path& file : stream)
+    {
+        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = pointProcessor.loadPcd(file.string());
+
+        auto startTime = std::chrono::steady_clock::now();
+        std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> pclSegment =
+            pointProcessor.SegmentPlane(cloud, SEG_MAX_ITER, SEG_THRESHOLD, PclRansac);
+        double frameMs = elapsedMs(startTime);
+        pclMs += frameMs;
+        pclWorstMs = std::max(pclWorstMs, frameMs);
+        pclRoad += pclSegment.second->points.size();
+
+        startTime = std::chrono::steady_clock::now();
+        std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> nativeSegment =
+            pointProcessor.SegmentPlane(cloud, SEG_MAX_ITER, SEG_THRESHOLD, NativeRansac);
+        frameMs = elapsedMs(startTime);
+        nativeMs += frameMs;
+        nativeWorstMs = std::max(nativeWorstMs, frameMs);
+        nativeRoad += nativeSegment.second->points.size();
+
+        serialRansac.setInputCloud(cloud->points);
+        serialRansac.segment(SEG_MAX_ITER, SEG_THRESHOLD, serialInliers);
+        threadedRansac.setInputCloud(cloud->points);
+        threadedRansac.segment(SEG_MAX_ITER, SEG_THRESHOLD, threadedInliers);
+        if(serialInliers != threadedInliers || !std::equal(serialRansac.coefficients, serialRansac.coefficients + 4, threadedRansac.coefficients))
+            differentFrames++;
+    }
+
+    int frames = std::max<int>(stream.size(), 1);
+    std::cout << dataPath << " (" << stream.size() << " frames, " << SEG_MAX_ITER << " iterations, threshold " << SEG_THRESHOLD << ")" << std::endl;
+    std::cout << "  pcl::SACSegmentation  mean " << pclMs/frames << " ms, worst " << pclWorstMs << " ms, "
+              << pclRoad/frames << " road points/frame" << std::endl;
+    std::cout << "  RansacPlane           mean " << nativeMs/frames << " ms, worst " << nativeWorstMs << " ms, "
+              << nativeRoad/frames << " road points/frame" << std::endl;
+    std::cout << "  RansacPlane 1 vs " << threadedRansac.numThreads << " threads: " << differentFrames << " of "
+              << stream.size() << " frames differ" << std::endl;
+    return differentFrames > 0 ? 1 : 0;
+}
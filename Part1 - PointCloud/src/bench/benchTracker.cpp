@@ -0,0 +1,124 @@
+// Update latency of the Tracker on a synthetic scene: objects moving at constant velocity,
+// detected with gaussian position noise and a share of missed detections every frame.
+// Also counts id switches, a confirmed track whose nearest object changes.
+
+#include "../tracking/tracker.h"
+#include "../utils/random.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TRACKING_DT 0.1
+// Objects start in a square of this half size, m, and move at up to MAX_SPEED m/s per axis
+#define SCENE_HALF_SIZE 200
+#define MAX_SPEED 10
+#define NOISE_STDDEV 0.1
+#define MISS_RATE 0.1
+
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+// Standard normal sample by Box-Muller
+float gaussian(RandomStream& random)
+{
+    float u = std::max(random.uniform(), 1e-7f), v = random.uniform();
+    return sqrtf(-2*logf(u)) * cosf(2*M_PI*v);
+}
+
+
+struct Object
+{
+    float x, y, vx, vy;
+};
+
+
+int nearestObject(const std::vector<Object>& objects, float x, float y)
+{
+    int nearest = -1;
+    float nearestSq = 0;
+    for(int o = 0; o < (int)objects.size(); o++)
+    {
+        float dx = objects[o].x - x, dy = objects[o].y - y;
+        if(nearest < 0 || dx*dx + dy*dy < nearestSq)
+        {
+            nearest = o;
+            nearestSq = dx*dx + dy*dy;
+        }
+    }
+    return nearest;
+}
+
+
+int main(int argc, char** argv)
+{
+    // usage: benchTracker [objects] [frames] [seed]
+    int numObjects = (argc > 1) ? std::stoi(argv[1]) : 400;
+    int numFrames = (argc > 2) ? std::stoi(argv[2]) : 1000;
+    RandomStream random((argc > 3) ? std::stoull(argv[3]) : 0);
+
+    std::vector<Object> objects(numObjects);
+    for(Object& object : objects)
+    {
+        object.x = random.uniform(-SCENE_HALF_SIZE, SCENE_HALF_SIZE);
+        object.y = random.uniform(-SCENE_HALF_SIZE, SCENE_HALF_SIZE);
+        object.vx = random.uniform(-MAX_SPEED, MAX_SPEED);
+        object.vy = random.uniform(-MAX_SPEED, MAX_SPEED);
+    }
+
+    Tracker tracker;
+    std::vector<BoxRecord> detections;
+    std::vector<TrackState> tracks;
+    // object each confirmed track id follows, -1 before it is confirmed
+    std::vector<int> followed;
+    double totalMs = 0, worstMs = 0;
+    long idSwitches = 0, confirmed = 0;
+
+    for(int frame = 0; frame < numFrames; frame++)
+    {
+        detections.clear();
+        for(Object& object : objects)
+        {
+            object.x += TRACKING_DT*object.vx;
+            object.y += TRACKING_DT*object.vy;
+            if(random.uniform() < MISS_RATE)
+                continue;
+            BoxRecord box;
+            box.x = object.x + NOISE_STDDEV*gaussian(random);
+            box.y = object.y + NOISE_STDDEV*gaussian(random);
+            box.z = 0;
+            box.length = 4;
+            box.width = 2;
+            box.height = 1.5;
+            box.yaw = 0;
+            detections.push_back(box);
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        tracker.update(detections, TRACKING_DT);
+        double frameMs = elapsedMs(startTime);
+        totalMs += frameMs;
+        worstMs = std::max(worstMs, frameMs);
+
+        tracker.confirmedTracks(tracks);
+        confirmed = tracks.size();
+        for(const TrackState& track : tracks)
+        {
+            if(track.id >= (int)followed.size())
+                followed.resize(track.id + 1, -1);
+            int object = nearestObject(objects, track.x, track.y);
+            if(followed[track.id] >= 0 && followed[track.id] != object)
+                idSwitches++;
+            followed[track.id] = object;
+        }
+    }
+
+    std::cout << numObjects << " objects, " << numFrames << " frames, " << MISS_RATE*100 << "% missed, "
+              << NOISE_STDDEV << " m noise" << std::endl;
+    std::cout << "  update " << totalMs/std::max(numFrames, 1) << " ms mean, " << worstMs << " ms worst" << std::endl;
+    std::cout << "  " << confirmed << " confirmed tracks at the end, " << idSwitches << " id switches" << std::endl;
+}
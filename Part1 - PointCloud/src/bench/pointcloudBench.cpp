@@ -0,0 +1,315 @@
+// Google Benchmark suite of the point cloud kernels: FilterCloud, SegmentPlane, Clustering,
+// BoundingBox, the custom KdTree and RansacPlane, on a synthetic street and on the first frame
+// of data_1 and data_2, each at several sizes. Results are machine readable with the usual flags:
+//
+//   pointcloud_bench --benchmark_format=json --benchmark_out=bench.json [dataPath]
+//
+// Every benchmark takes two arguments, the source (0 synthetic, 1 data_1, 2 data_2) and the number
+// of points. Recorded frames are subsampled with a fixed stride and used whole when they are smaller.
+// Clustering, BoundingBox and KdTree run on the obstacles of that cloud, like in the frame loop.
+
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include "../cluster/kdtree.h"
+#include "../ransac/ransacPlane.h"
+#include "../utils/random.h"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <string>
+
+// Same settings as environment.cpp
+#define GRID_SIZE 0.4
+#define ROI_MIN -10,-5,-2,1
+#define ROI_MAX 30,8,1,1
+#define SEG_MAX_ITER 30
+#define SEG_THRESHOLD 0.35
+#define CLUSTER_MIN_SIZE 10
+#define CLUSTER_MAX_SIZE 500
+#define CLUSTER_TOLERANCE 0.53
+// Obstacles of the synthetic street and their share of its points
+#define SYNTHETIC_OBSTACLES 12
+#define SYNTHETIC_OBSTACLE_SHARE 0.3
+
+typedef pcl::PointXYZI BenchPoint;
+
+enum BenchSource
+{
+    Synthetic, Data1, Data2
+};
+
+// Where data_1 and data_2 are, the first argument left after the benchmark flags
+std::string dataPath = "../src/sensors/data/pcd";
+
+
+ProcessPointClouds<BenchPoint>& benchProcessor()
+{
+    static ProcessPointClouds<BenchPoint> pointProcessor;
+    return pointProcessor;
+}
+
+
+// Road plane at the sensor height plus box shaped obstacles, all inside the region FilterCloud keeps.
+// Always the same cloud for the same size.
+pcl::PointCloud<BenchPoint>::Ptr syntheticStreet(int numPoints)
+{
+    pcl::PointCloud<BenchPoint>::Ptr cloud(new pcl::PointCloud<BenchPoint>);
+    cloud->points.reserve(numPoints);
+    RandomStream random(1);
+
+    float centers[SYNTHETIC_OBSTACLES][3];
+    for(int o = 0; o < SYNTHETIC_OBSTACLES; o++)
+    {
+        centers[o][0] = random.uniform(-6, 26);
+        centers[o][1] = random.uniform(-3.5, 6.5);
+        centers[o][2] = -1.0;
+    }
+
+    int numObstacle = numPoints * SYNTHETIC_OBSTACLE_SHARE;
+    for(int i = 0; i < numPoints; i++)
+    {
+        BenchPoint point;
+        if(i < numObstacle)
+        {
+            // surface points of a 4 x 2 x 1.4 m car
+            const float *center = centers[i % SYNTHETIC_OBSTACLES];
+            point.x = center[0] + random.uniform(-2, 2);
+            point.y = center[1] + random.uniform(-1, 1);
+            point.z = center[2] + random.uniform(-0.7, 0.7);
+        }
+        else
+        {
+            point.x = random.uniform(-10, 30);
+            point.y = random.uniform(-5, 8);
+            point.z = -1.73 + random.uniform(-0.05, 0.05);
+        }
+        point.intensity = random.uniform();
+        cloud->points.push_back(point);
+    }
+    cloud->width = numPoints;
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+}
+
+
+// Every n-th point of the first frame of a recorded stream, numPoints of them at most
+pcl::PointCloud<BenchPoint>::Ptr recordedFrame(const std::string& stream, int numPoints)
+{
+    std::vector<boost::filesystem::path> files = benchProcessor().streamPcd(dataPath + "/" + stream);
+    pcl::PointCloud<BenchPoint>::Ptr frame = benchProcessor().loadPcdMapped(files.front().string());
+    int stride = std::max<int>(1, (frame->points.size() + numPoints - 1) / numPoints);
+
+    pcl::PointCloud<BenchPoint>::Ptr cloud(new pcl::PointCloud<BenchPoint>);
+    for(int i = 0; i < (int)frame->points.size(); i += stride)
+        cloud->points.push_back(frame->points[i]);
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+}
+
+
+// What the benchmarks of one source and size run on, built once and shared between them
+struct BenchInput
+{
+    pcl::PointCloud<BenchPoint>::Ptr cloud;
+    // NativeRansac obstacles of the fused filter output
+    pcl::PointCloud<BenchPoint>::Ptr obstacles;
+    ClusterSet<BenchPoint> clusters;
+};
+
+
+const BenchInput& benchInput(const benchmark::State& state)
+{
+    static std::map<std::pair<int, int>, BenchInput> inputs;
+    std::pair<int, int> key((int)state.range(0), (int)state.range(1));
+    std::map<std::pair<int, int>, BenchInput>::iterator found = inputs.find(key);
+    if(found != inputs.end())
+        return found->second;
+
+    BenchInput& input = inputs[key];
+    if(key.first == Synthetic)
+        input.cloud = syntheticStreet(key.second);
+    else
+        input.cloud = recordedFrame(key.first == Data1 ? "data_1" : "data_2", key.second);
+
+    ProcessPointClouds<BenchPoint>& pointProcessor = benchProcessor();
+    pcl::PointCloud<BenchPoint>::Ptr filtered = pointProcessor.FilterCloudFused(input.cloud, GRID_SIZE, Eigen::Vector4f(ROI_MIN), Eigen::Vector4f(ROI_MAX));
+    input.obstacles = pointProcessor.SegmentPlane(filtered, SEG_MAX_ITER, SEG_THRESHOLD, NativeRansac).first;
+    pointProcessor.Clustering(input.obstacles, CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, input.clusters, CustomKdTree);
+    return input;
+}
+
+
+// Points per iteration as items/s, plus the actual input size since recorded frames may be smaller
+void reportPoints(benchmark::State& state, int numPoints)
+{
+    state.SetItemsProcessed(state.iterations() * numPoints);
+    state.counters["points"] = numPoints;
+}
+
+
+void BM_FilterCloud(benchmark::State& state)
+{
+    const BenchInput& input = benchInput(state);
+    for(auto _ : state)
+    {
+        pcl::PointCloud<BenchPoint>::Ptr filtered = benchProcessor().FilterCloud(input.cloud, GRID_SIZE, Eigen::Vector4f(ROI_MIN), Eigen::Vector4f(ROI_MAX));
+        benchmark::DoNotOptimize(filtered->points.data());
+    }
+    reportPoints(state, input.cloud->points.size());
+}
+
+
+void BM_FilterCloudFused(benchmark::State& state)
+{
+    const BenchInput& input = benchInput(state);
+    for(auto _ : state)
+    {
+        pcl::PointCloud<BenchPoint>::Ptr filtered = benchProcessor().FilterCloudFused(input.cloud, GRID_SIZE, Eigen::Vector4f(ROI_MIN), Eigen::Vector4f(ROI_MAX));
+        benchmark::DoNotOptimize(filtered->points.data());
+    }
+    reportPoints(state, input.cloud->points.size());
+}
+
+
+void BM_SegmentPlane(benchmark::State& state, PlaneBackend backend)
+{
+    const BenchInput& input = benchInput(state);
+    int road = 0;
+    for(auto _ : state)
+    {
+        std::pair<pcl::PointCloud<BenchPoint>::Ptr, pcl::PointCloud<BenchPoint>::Ptr> segmented =
+            benchProcessor().SegmentPlane(input.cloud, SEG_MAX_ITER, SEG_THRESHOLD, backend);
+        road = segmented.second->points.size();
+    }
+    reportPoints(state, input.cloud->points.size());
+    state.counters["road"] = road;
+}
+
+
+void BM_Clustering(benchmark::State& state, ClusterBackend backend)
+{
+    const BenchInput& input = benchInput(state);
+    ClusterSet<BenchPoint> clusters;
+    for(auto _ : state)
+        benchProcessor().Clustering(input.obstacles, CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, clusters, backend);
+    reportPoints(state, input.obstacles->points.size());
+    state.counters["clusters"] = clusters.size();
+}
+
+
+// Axis aligned boxes of every cluster of the frame
+void BM_BoundingBox(benchmark::State& state)
+{
+    const BenchInput& input = benchInput(state);
+    for(auto _ : state)
+        for(int c = 0; c < input.clusters.size(); c++)
+        {
+            Box box = benchProcessor().BoundingBox(input.clusters, c);
+            benchmark::DoNotOptimize(box);
+        }
+    reportPoints(state, input.clusters.points.size());
+    state.counters["clusters"] = input.clusters.size();
+}
+
+
+void BM_KdTreeBuild(benchmark::State& state)
+{
+    const BenchInput& input = benchInput(state);
+    const pcl::PointCloud<BenchPoint>& cloud = *input.obstacles;
+    KdTree<3> tree;
+    for(auto _ : state)
+    {
+        tree.clear();
+        tree.reserve(cloud.points.size());
+        for(int index = 0; index < (int)cloud.points.size(); index++)
+            tree.insert(cloud.points[index].data, index);
+        tree.build();
+    }
+    reportPoints(state, cloud.points.size());
+}
+
+
+// One radius search of the cluster tolerance around every point
+void BM_KdTreeSearch(benchmark::State& state)
+{
+    const BenchInput& input = benchInput(state);
+    const pcl::PointCloud<BenchPoint>& cloud = *input.obstacles;
+    KdTree<3> tree;
+    tree.reserve(cloud.points.size());
+    for(int index = 0; index < (int)cloud.points.size(); index++)
+        tree.insert(cloud.points[index].data, index);
+    tree.build();
+
+    std::vector<int> nearby;
+    long neighbours = 0;
+    for(auto _ : state)
+    {
+        neighbours = 0;
+        for(int index = 0; index < (int)cloud.points.size(); index++)
+        {
+            nearby.clear();
+            tree.search(cloud.points[index].data, CLUSTER_TOLERANCE, nearby);
+            neighbours += nearby.size();
+        }
+    }
+    reportPoints(state, cloud.points.size());
+    state.counters["neighbours"] = neighbours;
+}
+
+
+// RansacPlane alone, without the split into road and obstacle clouds of SegmentPlane
+void BM_RansacPlane(benchmark::State& state, int numThreads)
+{
+    const BenchInput& input = benchInput(state);
+    RansacPlane ransac;
+    if(numThreads > 0)
+        ransac.numThreads = numThreads;
+    ransac.setInputCloud(input.cloud->points);
+    std::vector<int> inliers;
+    int hypotheses = 0;
+    for(auto _ : state)
+        hypotheses = ransac.segment(SEG_MAX_ITER, SEG_THRESHOLD, inliers);
+    reportPoints(state, input.cloud->points.size());
+    state.counters["inliers"] = inliers.size();
+    state.counters["hypotheses"] = hypotheses;
+}
+
+
+// Every source at three sizes, the biggest about a whole recorded frame
+void benchInputs(benchmark::internal::Benchmark* bench)
+{
+    for(int source : {Synthetic, Data1, Data2})
+        for(int numPoints : {1 << 12, 1 << 15, 1 << 17})
+            bench->Args({source, numPoints});
+    bench->ArgNames({"source", "points"})->Unit(benchmark::kMicrosecond);
+}
+
+
+BENCHMARK(BM_FilterCloud)->Apply(benchInputs);
+BENCHMARK(BM_FilterCloudFused)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_SegmentPlane, pcl, PclRansac)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_SegmentPlane, native, NativeRansac)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_Clustering, pclKdTree, PclKdTree)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_Clustering, customKdTree, CustomKdTree)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_Clustering, voxelHash, VoxelHash)->Apply(benchInputs);
+BENCHMARK(BM_BoundingBox)->Apply(benchInputs);
+BENCHMARK(BM_KdTreeBuild)->Apply(benchInputs);
+BENCHMARK(BM_KdTreeSearch)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_RansacPlane, serial, 1)->Apply(benchInputs);
+BENCHMARK_CAPTURE(BM_RansacPlane, threads, 0)->Apply(benchInputs);
+
+
+int main(int argc, char** argv)
+{
+    // usage: pointcloud_bench [benchmark flags] [dataPath]
+    benchmark::Initialize(&argc, argv);
+    if(argc > 1)
+        dataPath = argv[1];
+
+    benchProcessor().setVerbose(false);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -1,11 +1,12 @@
 /* \author Aaron Brown */
 // Quiz on implementing simple RANSAC line fitting
 
-#include "../../render/render.h"
-#include "../../render/box.h"
+#include "../render/render.h"
+#include "../render/box.h"
 #include <chrono>
 #include <string>
 #include "kdtree.h"
+#include "euclideanCluster.h"
 
 // Arguments:
 // window is the region to draw box around
@@ -44,73 +45,48 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr CreateData(std::vector<std::vector<float>> p
 }
 
 
-void render2DTree(Node* node, pcl::visualization::PCLVisualizer::Ptr& viewer, Box window, int& iteration, uint depth=0)
+void render2DTree(KdTree<2>* tree, pcl::visualization::PCLVisualizer::Ptr& viewer, Box window, int& iteration, int begin, int end, uint depth=0)
 {
 
-	if(node!=NULL)
+	if(begin < end)
 	{
+		// node of the range is its median slot, see KdTree
+		int node = begin + (end - begin)/2;
+		float nodeX = tree->coords[node*2];
+		float nodeY = tree->coords[node*2 + 1];
+
 		Box upperWindow = window;
 		Box lowerWindow = window;
 		// split on x axis
 		if(depth%2==0)
 		{
-			viewer->addLine(pcl::PointXYZ(node->point[0], window.y_min, 0),pcl::PointXYZ(node->point[0], window.y_max, 0),0,0,1,"line"+std::to_string(iteration));
-			lowerWindow.x_max = node->point[0];
-			upperWindow.x_min = node->point[0];
+			viewer->addLine(pcl::PointXYZ(nodeX, window.y_min, 0),pcl::PointXYZ(nodeX, window.y_max, 0),0,0,1,"line"+std::to_string(iteration));
+			lowerWindow.x_max = nodeX;
+			upperWindow.x_min = nodeX;
 		}
 		// split on y axis
 		else
 		{
-			viewer->addLine(pcl::PointXYZ(window.x_min, node->point[1], 0),pcl::PointXYZ(window.x_max, node->point[1], 0),1,0,0,"line"+std::to_string(iteration));
-			lowerWindow.y_max = node->point[1];
-			upperWindow.y_min = node->point[1];
+			viewer->addLine(pcl::PointXYZ(window.x_min, nodeY, 0),pcl::PointXYZ(window.x_max, nodeY, 0),1,0,0,"line"+std::to_string(iteration));
+			lowerWindow.y_max = nodeY;
+			upperWindow.y_min = nodeY;
 		}
 		iteration++;
 
-		render2DTree(node->left,viewer, lowerWindow, iteration, depth+1);
-		render2DTree(node->right,viewer, upperWindow, iteration, depth+1);
+		render2DTree(tree, viewer, lowerWindow, iteration, begin, node, depth+1);
+		render2DTree(tree, viewer, upperWindow, iteration, node+1, end, depth+1);
 	}
 
 }
 
-void proximity(std::vector<std::vector<float>> points, KdTree* tree, std::vector<int> &cluster, \
-			   std::vector<bool> &isProcessed, int &pntIndex, float &distanceTol)
-{
-	isProcessed[pntIndex] = true;
-	cluster.push_back(pntIndex);
-
-	std::vector<int> nearbyPntIds = tree->search(points[pntIndex], distanceTol);
-
-	for(int id : nearbyPntIds){
-
-		if(isProcessed[pntIndex])
-			continue;
-		
-		proximity(points, tree ,cluster, isProcessed, id, distanceTol);
-
-	}
-}
-
-std::vector<std::vector<int>> euclideanCluster(const std::vector<std::vector<float>>& points, KdTree* tree, float distanceTol)
+std::vector<std::vector<int>> euclideanCluster(const std::vector<std::vector<float>>& points, KdTree<2>* tree, float distanceTol)
 {
 
-	// TODO: Fill out this function to return list of indices for each cluster
-
-	std::vector<std::vector<int>> clusters;
-	std::vector<bool> isProcessed(points.size(),false);
-	
-	for(int pntIndex = 0; pntIndex < points.size(); pntIndex++){
-
-		if(isProcessed[pntIndex])
-			continue;
-		
-		std::vector<int> cluster;
-		proximity(points, tree ,cluster, isProcessed, pntIndex, distanceTol);
-
-		clusters.push_back(cluster);
-	}
+	// Iterative clustering with an explicit queue, see euclideanCluster.h
+	EuclideanCluster clustering;
+	clustering.extract(*tree, [&points](int id){ return &points[id][0]; }, points.size(), distanceTol, 1, points.size());
 
-	return clusters;
+	return clustering.clusters();
 }
 
 int main ()
@@ -131,13 +107,14 @@ int main ()
 	//std::vector<std::vector<float>> points = { {-6.2,7}, {-6.3,8.4}, {-5.2,7.1}, {-5.7,6.3} };
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = CreateData(points);
 
-	KdTree* tree = new KdTree;
+	KdTree<2>* tree = new KdTree<2>;
   
     for (int i=0; i<points.size(); i++) 
     	tree->insert(points[i],i); 
+    tree->build();
 
   	int it = 0;
-  	render2DTree(tree->root,viewer,window, it);
+  	render2DTree(tree,viewer,window, it, 0, tree->size());
   
   	std::cout << "Test Search" << std::endl;
   	std::vector<int> nearby = tree->search({-6,7},3.0);
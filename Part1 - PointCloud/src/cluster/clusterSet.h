@@ -0,0 +1,75 @@
+// Clustering result without a cloud per cluster: the points of every cluster are
+// gathered back to back into one buffer and each cluster is a range of it
+
+#ifndef CLUSTER_SET_H
+#define CLUSTER_SET_H
+
+#include <pcl/point_cloud.h>
+#include <vector>
+
+// One instance can be reused frame after frame, clear() keeps the capacity of both buffers
+template<typename PointT>
+struct ClusterSet
+{
+	// points of all clusters, biggest cluster first
+	typename pcl::PointCloud<PointT>::VectorType points;
+	// cluster c is points[offsets[c], offsets[c+1])
+	std::vector<int> offsets;
+
+	ClusterSet()
+	: offsets(1, 0)
+	{}
+
+	int size() const
+	{
+		return offsets.size() - 1;
+	}
+
+	int clusterSize(int cluster) const
+	{
+		return offsets[cluster+1] - offsets[cluster];
+	}
+
+	const PointT* begin(int cluster) const
+	{
+		return points.data() + offsets[cluster];
+	}
+
+	const PointT* end(int cluster) const
+	{
+		return points.data() + offsets[cluster+1];
+	}
+
+	void clear()
+	{
+		points.clear();
+		offsets.assign(1, 0);
+	}
+
+	// Append the points of cloud listed in indices[0, count) as a new cluster
+	void add(const typename pcl::PointCloud<PointT>::VectorType &cloud, const int *indices, int count)
+	{
+		for(int i = 0; i < count; i++)
+			points.push_back(cloud[indices[i]]);
+		offsets.push_back(points.size());
+	}
+
+	// One cloud per cluster as Clustering used to return, copies every point
+	std::vector<typename pcl::PointCloud<PointT>::Ptr> toClouds() const
+	{
+		std::vector<typename pcl::PointCloud<PointT>::Ptr> clouds;
+		clouds.reserve(size());
+		for(int cluster = 0; cluster < size(); cluster++)
+		{
+			typename pcl::PointCloud<PointT>::Ptr cloudCluster (new pcl::PointCloud<PointT>);
+			cloudCluster->points.assign(begin(cluster), end(cluster));
+			cloudCluster->width = cloudCluster->points.size();
+			cloudCluster->height = 1;
+			cloudCluster->is_dense = true;
+			clouds.push_back(cloudCluster);
+		}
+		return clouds;
+	}
+};
+
+#endif /* CLUSTER_SET_H */
@@ -0,0 +1,91 @@
+// Euclidean clustering over a spatial index, iterative and without per call allocations
+
+#ifndef EUCLIDEAN_CLUSTER_H
+#define EUCLIDEAN_CLUSTER_H
+
+#include <vector>
+#include <algorithm>
+
+// Holds the scratch buffers of the clustering so one instance can be reused frame after frame,
+// after warm up extract() only grows its buffers when a frame is bigger than any before.
+struct EuclideanCluster
+{
+	// visited flag per point, std::vector<bool> is stored as a bitset
+	std::vector<bool> visited;
+	// result buffer handed to every radius search
+	std::vector<int> nearby;
+	// point ids of all kept clusters back to back, doubles as the work queue while a cluster grows
+	std::vector<int> indices;
+	// cluster c is indices[offsets[c], offsets[c+1])
+	std::vector<int> offsets;
+
+	int numClusters() const
+	{
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	int clusterSize(int cluster) const
+	{
+		return offsets[cluster+1] - offsets[cluster];
+	}
+
+	// tree:     any index with search(const float* target, float distanceTol, std::vector<int>& nearby)
+	// getPoint: returns the coordinates of point i as const float*
+	// Clusters smaller than minSize or larger than maxSize are dropped, like pcl::EuclideanClusterExtraction.
+	template<typename Tree, typename GetPoint>
+	int extract(Tree& tree, GetPoint getPoint, int numPoints, float distanceTol, int minSize, int maxSize)
+	{
+		visited.assign(numPoints, false);
+		indices.clear();
+		offsets.assign(1, 0);
+
+		for(int seed = 0; seed < numPoints; seed++)
+		{
+			if(visited[seed])
+				continue;
+
+			// Breadth first growth, points are marked when queued so each one enters the queue once
+			int clusterBegin = indices.size();
+			indices.push_back(seed);
+			visited[seed] = true;
+
+			for(int head = clusterBegin; head < (int)indices.size(); head++)
+			{
+				nearby.clear();
+				tree.search(getPoint(indices[head]), distanceTol, nearby);
+
+				for(int id : nearby)
+				{
+					if(visited[id])
+						continue;
+					visited[id] = true;
+					indices.push_back(id);
+				}
+			}
+
+			int clusterSize = indices.size() - clusterBegin;
+			if(clusterSize < minSize || clusterSize > maxSize)
+			{
+				indices.resize(clusterBegin);
+				continue;
+			}
+
+			std::sort(indices.begin() + clusterBegin, indices.end());
+			offsets.push_back(indices.size());
+		}
+
+		return numClusters();
+	}
+
+	// Copy of the clusters as separate index lists
+	std::vector<std::vector<int>> clusters() const
+	{
+		std::vector<std::vector<int>> result(numClusters());
+		for(int cluster = 0; cluster < numClusters(); cluster++)
+			result[cluster].assign(indices.begin() + offsets[cluster], indices.begin() + offsets[cluster+1]);
+		return result;
+	}
+
+};
+
+#endif /* EUCLIDEAN_CLUSTER_H */
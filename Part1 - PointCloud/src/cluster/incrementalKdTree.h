@@ -0,0 +1,347 @@
+// Kd tree that is updated with the delta between consecutive frames instead of being rebuilt.
+//
+// Points live in slots. A slot is indexed at the position it had when it entered the index and
+// may drift up to quantum away from it: searches widen the radius by quantum and check the exact
+// current position, so results are exact while points that barely moved cost nothing to update.
+// Slots are split between a main tree and a small delta tree of recent inserts; deletes are
+// tombstones. Once the delta tree or the tombstones outgrow rebuildFraction of the main tree,
+// everything is rebuilt into a fresh main tree. When frames share too little for matching to
+// pay off, e.g. while the sensor moves, update() replaces the index outright and only tries to
+// match again every probeInterval frames.
+
+#ifndef INCREMENTAL_KDTREE_H
+#define INCREMENTAL_KDTREE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "kdtree.h"
+
+struct IncrementalKdTreeStats
+{
+	long frames;
+	// slots matched to a point of the new frame, inserted and removed by update()
+	long kept;
+	long inserted;
+	long removed;
+	long rebuilds;
+	// filled by the caller: time spent in update() and, when measured, building a fresh KdTree of the same frames
+	double updateMs;
+	double fullBuildMs;
+
+	IncrementalKdTreeStats()
+	: frames(0), kept(0), inserted(0), removed(0), rebuilds(0), updateMs(0), fullBuildMs(0)
+	{}
+};
+
+template<int Dim>
+struct IncrementalKdTree
+{
+	// how far a point may drift from its indexed position before it is reinserted
+	float quantum;
+	// share of the main tree the delta tree or the tombstones may reach before a rebuild
+	float rebuildFraction;
+	// frames between two matching attempts while frames share too little
+	int probeInterval;
+	IncrementalKdTreeStats stats;
+
+	IncrementalKdTree()
+	: quantum(0.05), rebuildFraction(0.25), probeInterval(8), mainSize(0), mainDead(0), numAlive(0), skipped(0)
+	{}
+
+	int size() const
+	{
+		return numAlive;
+	}
+
+	// Batch insert, points[i] gets point id ids[i]. The points go to the delta tree.
+	void insert(const std::vector<const float*> &points, const std::vector<int> &ids)
+	{
+		for(size_t i = 0; i < points.size(); i++)
+			addSlot(points[i], ids[i]);
+		numAlive += points.size();
+		if(needsRebuild())
+			rebuild();
+		else
+			buildDelta();
+		stats.inserted += points.size();
+	}
+
+	// Batch delete by point id
+	void remove(const std::vector<int> &ids)
+	{
+		if(ids.empty())
+			return;
+		std::vector<bool> removing(*std::max_element(ids.begin(), ids.end()) + 1, false);
+		for(int id : ids)
+			removing[id] = true;
+		for(int slot = 0; slot < (int)pointOf.size(); slot++)
+			if(pointOf[slot] >= 0 && pointOf[slot] < (int)removing.size() && removing[pointOf[slot]])
+				removeSlot(slot);
+		stats.removed += ids.size();
+		if(needsRebuild())
+			rebuild();
+	}
+
+	// Replace the indexed cloud by the next frame, getPoint(i) returns the coordinates of point i as const float*.
+	// Slots of the old frame are matched to new points within quantum of their indexed position, the rest of
+	// the old slots are deleted and the unmatched new points inserted.
+	template<typename GetPoint>
+	void update(GetPoint getPoint, int numPoints)
+	{
+		stats.frames++;
+		if(skipped > 0 && skipped < probeInterval)
+		{
+			skipped++;
+			replace(getPoint, numPoints);
+			return;
+		}
+
+		int previousAlive = numAlive;
+
+		// Alive slots by the cell of their indexed position, linked through nextInCell
+		int tableSize = 16;
+		while(tableSize < 2*numAlive)
+			tableSize *= 2;
+		tableKey.resize(tableSize);
+		tableHead.assign(tableSize, -1);
+		nextInCell.assign(pointOf.size(), -1);
+		for(int slot = 0; slot < (int)pointOf.size(); slot++)
+			if(pointOf[slot] >= 0)
+			{
+				uint64_t key = cellKey(&indexed[slot*Dim]);
+				int cell = findCell(key);
+				tableKey[cell] = key;
+				nextInCell[slot] = tableHead[cell];
+				tableHead[cell] = slot;
+			}
+
+		std::vector<int> &previousPoint = claimed;
+		previousPoint.swap(pointOf);
+		pointOf.assign(previousPoint.size(), -1);
+
+		int added = 0;
+		const float quantumSq = quantum*quantum;
+		for(int id = 0; id < numPoints; id++)
+		{
+			const float *point = getPoint(id);
+			// closest free slot, returns of a dense scan are closer together than quantum. A point that
+			// found none in its cell may have drifted over a face, the nearer neighbour on every axis is tried.
+			int match = -1;
+			float matchSq = quantumSq;
+			if(previousAlive > 0)
+			{
+				closestFreeSlot(point, point, match, matchSq);
+				for(int axis = 0; axis < Dim && match < 0; axis++)
+				{
+					float shifted[Dim];
+					std::copy(point, point + Dim, shifted);
+					float cellSize = 2*quantum;
+					shifted[axis] += point[axis]/cellSize - floorf(point[axis]/cellSize) < 0.5f ? -cellSize : cellSize;
+					closestFreeSlot(shifted, point, match, matchSq);
+				}
+			}
+
+			if(match >= 0)
+			{
+				pointOf[match] = id;
+				std::copy(point, point + Dim, &position[match*Dim]);
+				stats.kept++;
+			}
+			else
+			{
+				addSlot(point, id);
+				added++;
+			}
+		}
+
+		// Old slots nobody claimed are tombstones from now on
+		for(int slot = 0; slot < (int)previousPoint.size(); slot++)
+			if(previousPoint[slot] >= 0 && pointOf[slot] < 0)
+			{
+				if(slot < mainSize)
+					mainDead++;
+				stats.removed++;
+			}
+		stats.inserted += added;
+		numAlive = numPoints;
+		// nothing to match against is not a reason to stop matching
+		skipped = previousAlive > 0 && numPoints - added < (1 - rebuildFraction)*numPoints ? 1 : 0;
+
+		if(needsRebuild())
+			rebuild();
+		else if(added > 0)
+			buildDelta();
+	}
+
+	// Point ids within distanceTol of target appended to nearby
+	void search(const float *target, float distanceTol, std::vector<int> &nearby)
+	{
+		candidates.clear();
+		mainTree.search(target, distanceTol + quantum, candidates);
+		deltaTree.search(target, distanceTol + quantum, candidates);
+		const float distanceTolSq = distanceTol*distanceTol;
+		for(int slot : candidates)
+			if(pointOf[slot] >= 0 && distanceSq(&position[slot*Dim], target) <= distanceTolSq)
+				nearby.push_back(pointOf[slot]);
+	}
+
+	// Fresh main tree over the alive slots at their current positions, slots are renumbered
+	void rebuild()
+	{
+		int alive = 0;
+		for(int slot = 0; slot < (int)pointOf.size(); slot++)
+			if(pointOf[slot] >= 0)
+			{
+				std::copy(&position[slot*Dim], &position[slot*Dim] + Dim, &position[alive*Dim]);
+				pointOf[alive++] = pointOf[slot];
+			}
+		pointOf.resize(alive);
+		position.resize(alive*Dim);
+		indexed = position;
+
+		mainTree.clear();
+		mainTree.reserve(alive);
+		for(int slot = 0; slot < alive; slot++)
+			mainTree.insert(&indexed[slot*Dim], slot);
+		mainTree.build();
+		mainSize = alive;
+		mainDead = 0;
+		deltaTree.clear();
+		deltaSlots.clear();
+		numAlive = alive;
+		stats.rebuilds++;
+	}
+
+	void clear()
+	{
+		mainTree.clear();
+		deltaTree.clear();
+		std::vector<float>().swap(indexed);
+		std::vector<float>().swap(position);
+		std::vector<int>().swap(pointOf);
+		deltaSlots.clear();
+		mainSize = mainDead = numAlive = skipped = 0;
+	}
+
+private:
+
+	static float distanceSq(const float *a, const float *b)
+	{
+		float sum = 0;
+		for(int axis = 0; axis < Dim; axis++)
+			sum += (a[axis] - b[axis])*(a[axis] - b[axis]);
+		return sum;
+	}
+
+	// Cells of twice quantum so most points that drifted less than quantum stay in their cell, 21 bits per axis for Dim up to 3
+	uint64_t cellKey(const float *point) const
+	{
+		uint64_t key = 0;
+		for(int axis = 0; axis < Dim; axis++)
+			key = (key << 21) | ((uint64_t)((int64_t)floorf(point[axis] / (2*quantum)) + (1 << 20)) & 0x1fffff);
+		return key;
+	}
+
+	// Slot of the open addressing table that holds key or the empty slot where it goes
+	int findCell(uint64_t key) const
+	{
+		int mask = tableHead.size() - 1;
+		int cell = (key * 0x9e3779b97f4a7c15ULL) >> 40 & mask;
+		while(tableHead[cell] >= 0 && tableKey[cell] != key)
+			cell = (cell + 1) & mask;
+		return cell;
+	}
+
+	// Free slot of the cell of probe closest to point, if closer than matchSq
+	void closestFreeSlot(const float *probe, const float *point, int &match, float &matchSq) const
+	{
+		int cell = findCell(cellKey(probe));
+		if(tableKey[cell] != cellKey(probe))
+			return;
+		for(int slot = tableHead[cell]; slot >= 0; slot = nextInCell[slot])
+		{
+			float slotSq = distanceSq(&indexed[slot*Dim], point);
+			if(pointOf[slot] < 0 && slotSq <= matchSq)
+			{
+				match = slot;
+				matchSq = slotSq;
+			}
+		}
+	}
+
+	// Every point of the frame in a fresh index, what update() does when nothing would be kept
+	template<typename GetPoint>
+	void replace(GetPoint getPoint, int numPoints)
+	{
+		stats.removed += numAlive;
+		stats.inserted += numPoints;
+		pointOf.resize(numPoints);
+		position.resize(numPoints*Dim);
+		for(int id = 0; id < numPoints; id++)
+		{
+			pointOf[id] = id;
+			std::copy(getPoint(id), getPoint(id) + Dim, &position[id*Dim]);
+		}
+		rebuild();
+	}
+
+	// New slot for the delta tree, the caller accounts for numAlive
+	void addSlot(const float *point, int id)
+	{
+		deltaSlots.push_back(pointOf.size());
+		indexed.insert(indexed.end(), point, point + Dim);
+		position.insert(position.end(), point, point + Dim);
+		pointOf.push_back(id);
+	}
+
+	void removeSlot(int slot)
+	{
+		if(pointOf[slot] < 0)
+			return;
+		pointOf[slot] = -1;
+		if(slot < mainSize)
+			mainDead++;
+		numAlive--;
+	}
+
+	bool needsRebuild() const
+	{
+		return mainSize == 0 || deltaSlots.size() > rebuildFraction*mainSize || mainDead > rebuildFraction*mainSize;
+	}
+
+	// The delta tree is small, rebuilding it from scratch keeps it balanced
+	void buildDelta()
+	{
+		deltaTree.clear();
+		deltaTree.reserve(deltaSlots.size());
+		for(int slot : deltaSlots)
+			if(pointOf[slot] >= 0)
+				deltaTree.insert(&indexed[slot*Dim], slot);
+		deltaTree.build();
+	}
+
+	KdTree<Dim> mainTree;
+	KdTree<Dim> deltaTree;
+	// position a slot was indexed at and its exact current position, Dim floats per slot
+	std::vector<float> indexed;
+	std::vector<float> position;
+	// point id per slot, -1 for a tombstone
+	std::vector<int> pointOf;
+	// slots in the delta tree, the main tree holds slots [0, mainSize)
+	std::vector<int> deltaSlots;
+	int mainSize;
+	int mainDead;
+	int numAlive;
+	// frames replaced since the last matching attempt, 0 while matching pays off
+	int skipped;
+	// update() scratch, first slot per cell in an open addressing table
+	std::vector<uint64_t> tableKey;
+	std::vector<int> tableHead;
+	std::vector<int> nextInCell;
+	std::vector<int> claimed;
+	std::vector<int> candidates;
+};
+
+#endif /* INCREMENTAL_KDTREE_H */
@@ -1,109 +1,173 @@
 /* \author Aaron Brown */
 // Quiz on implementing kd tree
 
-#include "../../render/render.h"
-#include <math.h>
+#ifndef KDTREE_H
+#define KDTREE_H
 
-// Structure to represent node of kd tree
-struct Node
-{
-	std::vector<float> point;
-	int id;
-	Node* left;
-	Node* right;
-
-	Node(std::vector<float> arr, int setId)
-	:	point(arr), id(setId), left(NULL), right(NULL)
-	{}
-};
+#include <vector>
+#include <algorithm>
 
+// Flat kd tree: every node is a slot in one contiguous array. The tree is implicit,
+// the node of a range [begin, end) is its median slot and the two halves are its children,
+// so no child pointers are stored and the whole tree is freed with its buffers.
+// Dim is fixed at compile time so the per axis loops unroll, e.g. KdTree<2> for the quiz and KdTree<3> for lidar clouds.
+template<int Dim>
 struct KdTree
 {
-	Node* root;
-	uint depth;
+	// packed coordinates, Dim floats per node, reordered in tree order by build()
+	std::vector<float> coords;
+	// point id of every node slot
+	std::vector<int> ids;
+	bool isBuilt;
+
 	KdTree()
-	: root(NULL), depth(0)
+	: isBuilt(true)
 	{}
 
+	void insert(const float *point, int id)
+	{
+		// Points are only staged here, the tree is (re)built by median partitioning on the next search
+		coords.insert(coords.end(), point, point + Dim);
+		ids.push_back(id);
+		isBuilt = false;
+	}
 
-	void auxInsert(Node **node, std::vector<float> point, int &id, uint depth)
+	void insert(std::vector<float> point, int id)
 	{
-		if( *node == NULL){
-			*node = new Node(point, id);
-		}
+		point.resize(Dim, 0.0f);
+		insert(&point[0], id);
+	}
 
-		else{
-			
-			if(point[depth%2] < (*node)->point[depth%2])
-				auxInsert(&((*node)->left), point, id, depth+1);	
-			else
-				auxInsert(&((*node)->right), point, id, depth+1);	
+	void reserve(int numPoints)
+	{
+		coords.reserve(numPoints*Dim);
+		ids.reserve(numPoints);
+	}
 
+	// Build the tree from all staged points in O(n log n), each level is partitioned around its median
+	void build()
+	{
+		int numPoints = ids.size();
+		order.resize(numPoints);
+		for(int i = 0; i < numPoints; i++)
+			order[i] = i;
+
+		auxBuild(order, 0, numPoints, 0);
+
+		// Gather the points in tree order so a traversal walks memory front to back
+		sortedCoords.resize(coords.size());
+		sortedIds.resize(numPoints);
+		for(int slot = 0; slot < numPoints; slot++)
+		{
+			for(int axis = 0; axis < Dim; axis++)
+				sortedCoords[slot*Dim + axis] = coords[order[slot]*Dim + axis];
+			sortedIds[slot] = ids[order[slot]];
 		}
+		coords.swap(sortedCoords);
+		ids.swap(sortedIds);
+		isBuilt = true;
+	}
 
-		/* 
-		else if(depth %2 == 0){
+	void auxBuild(std::vector<int> &order, int begin, int end, int axis)
+	{
+		if(end - begin <= 1)
+			return;
 
-			if( point[0] < (*node)->point[0])
-				auxInsert(&((*node)->left), point, id, depth);
-			else
-				auxInsert(&((*node)->right), point, id, depth);	
-		}
-		else if(depth%2 != 0){
+		int median = begin + (end - begin)/2;
+		const std::vector<float> &points = coords;
+		std::nth_element(order.begin() + begin, order.begin() + median, order.begin() + end,
+			[&points, axis](int a, int b){ return points[a*Dim + axis] < points[b*Dim + axis]; });
 
-			if( point[1] < (*node)->point[1])
-				auxInsert(&((*node)->left), point, id, depth);
-			else
-				auxInsert(&((*node)->right), point, id, depth);	
-		} 
-		
-		*/
+		int nextAxis = (axis + 1 == Dim) ? 0 : axis + 1;
+		auxBuild(order, begin, median, nextAxis);
+		auxBuild(order, median+1, end, nextAxis);
+	}
 
+	void auxSearch(int begin, int end, int axis, const float *target, float distanceTol, float distanceTolSq, std::vector<int> &nearby) const
+	{
+		while(begin < end)
+		{
+			int node = begin + (end - begin)/2;
+			const float *point = &coords[node*Dim];
+
+			// Checking if the node within the box, then within the distance tolerance
+			bool inBox = true;
+			float distanceSq = 0;
+			for(int i = 0; i < Dim; i++)
+			{
+				float delta = point[i] - target[i];
+				inBox &= (delta >= -distanceTol) & (delta <= distanceTol);
+				distanceSq += delta*delta;
+			}
+			if(inBox && distanceSq <= distanceTolSq)
+				nearby.push_back(ids[node]);
+
+			// Whether to split left or right, equal keys may sit on either side of the median.
+			// One side is recursed into, the other continues in this loop.
+			int nextAxis = (axis + 1 == Dim) ? 0 : axis + 1;
+			bool goLeft = (target[axis] - distanceTol) <= point[axis];
+			bool goRight = (target[axis] + distanceTol) >= point[axis];
+			if(goLeft && goRight)
+			{
+				auxSearch(begin, node, nextAxis, target, distanceTol, distanceTolSq, nearby);
+				begin = node+1;
+			}
+			else if(goLeft)
+				end = node;
+			else
+				begin = node+1;
+			axis = nextAxis;
+		}
 	}
 
-	void insert(std::vector<float> point, int id)
+	// return a list of point ids in the tree that are within distance of target
+	std::vector<int> search(std::vector<float> target, float distanceTol)
 	{
-		// TODO: Fill in this function to insert a new point into the tree
-		// the function should create a new node and place correctly with in the root 
-		auxInsert(&(this->root), point, id, 0);
+		std::vector<int> nearby;
+		target.resize(Dim, 0.0f);
+		search(&target[0], distanceTol, nearby);
+		return nearby;
 	}
 
-	void auxSearch(Node *node, std::vector<float> target, int depth, float &distanceTol, std::vector<int> &ids )
+	// Same query appending into a caller owned buffer, so repeated searches reuse its capacity
+	void search(const float *target, float distanceTol, std::vector<int> &nearby)
 	{
-		if(node != NULL)
-		{	
-			// Checking if the node within the box
-			if(node->point[0] >= (target[0] - distanceTol) && node->point[0] <= (target[0] + distanceTol) && \
-			   node->point[1] >= (target[1] - distanceTol) && node->point[1] <= (target[1] + distanceTol))
-			   {
-				// Checking if the the point within the distance tolerance
-				float distance = sqrt( pow(node->point[0] - target[0],2) + pow(node->point[1] - target[1],2) );
-				if(distance <= distanceTol)
-					ids.push_back(node->id);
-			   }
-
-			   	// Whether to split left or right
-			   	if( (target[depth%2] - distanceTol) < node->point[depth%2])
-					auxSearch(node->left, target, depth+1, distanceTol, ids);
-				if( (target[depth%2] + distanceTol) > node->point[depth%2])
-					auxSearch(node->right, target, depth+1, distanceTol, ids);
-		}
-		
+		if(!isBuilt)
+			build();
+		auxSearch(0, ids.size(), 0, target, distanceTol, distanceTol*distanceTol, nearby);
 	}
 
-	// return a list of point ids in the tree that are within distance of target
-	std::vector<int> search(std::vector<float> target, float distanceTol)
+	int size() const
 	{
-		std::vector<int> ids;
+		return ids.size();
+	}
 
-		auxSearch(this->root, target, 0, distanceTol, ids);
-		
-		return ids;
+	// Release all memory held by the tree, called once a frame is done with it
+	void clear()
+	{
+		std::vector<float>().swap(coords);
+		std::vector<int>().swap(ids);
+		std::vector<int>().swap(order);
+		std::vector<float>().swap(sortedCoords);
+		std::vector<int>().swap(sortedIds);
+		isBuilt = true;
 	}
-	
 
-};
+	// Drop the points but keep every buffer, so building the next frame's tree does not allocate
+	void reset()
+	{
+		coords.clear();
+		ids.clear();
+		isBuilt = true;
+	}
 
+private:
 
+	// build() scratch, swapped with coords and ids so both pairs keep their capacity
+	std::vector<int> order;
+	std::vector<float> sortedCoords;
+	std::vector<int> sortedIds;
 
+};
 
+#endif /* KDTREE_H */
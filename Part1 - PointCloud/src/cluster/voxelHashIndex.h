@@ -0,0 +1,161 @@
+// Uniform voxel hash as a radius search index. With the cell size equal to the search radius
+// a query only looks at the 27 cells around the target, there is no tree to walk.
+
+#ifndef VOXEL_HASH_INDEX_H
+#define VOXEL_HASH_INDEX_H
+
+#include <pcl/point_cloud.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+// Reusable frame after frame, build() keeps the capacity of every buffer
+template<typename PointT>
+struct VoxelHashIndex
+{
+	float cellSize;
+	// coordinates and ids of the points grouped by cell, cell c is [cellBegin[c], cellBegin[c+1])
+	std::vector<float> coords;
+	std::vector<int> ids;
+	std::vector<int> cellBegin;
+
+	VoxelHashIndex()
+	: cellSize(1)
+	{}
+
+	// Index points in cells of setCellSize, the radius the index will mostly be searched with
+	void build(const typename pcl::PointCloud<PointT>::VectorType &points, float setCellSize)
+	{
+		build([&points](int id){ return points[id].data; }, points.size(), setCellSize);
+	}
+
+	// getPoint: returns the coordinates of point id as const float*, like EuclideanCluster::extract
+	template<typename GetPoint>
+	void build(GetPoint getPoint, int numPoints, float setCellSize)
+	{
+		cellSize = setCellSize;
+		int tableSize = 16;
+		while(tableSize < 2*numPoints)
+			tableSize *= 2;
+		tableKey.resize(tableSize);
+		tableCell.assign(tableSize, -1);
+		cellOf.resize(numPoints);
+		cellBegin.clear();
+
+		// One pass finds the cell of every point and counts the points per cell
+		for(int id = 0; id < numPoints; id++)
+		{
+			const float *point = getPoint(id);
+			uint64_t key = cellKey(cellCoord(point[0]), cellCoord(point[1]), cellCoord(point[2]));
+			int slot = findSlot(key);
+			if(tableCell[slot] < 0)
+			{
+				tableKey[slot] = key;
+				tableCell[slot] = cellBegin.size();
+				cellBegin.push_back(0);
+			}
+			cellOf[id] = tableCell[slot];
+			cellBegin[cellOf[id]]++;
+		}
+
+		// Counts to offsets, then the points are scattered to their cell's range
+		int offset = 0;
+		for(int &begin : cellBegin)
+		{
+			int count = begin;
+			begin = offset;
+			offset += count;
+		}
+		cellBegin.push_back(offset);
+		cursor.assign(cellBegin.begin(), cellBegin.end() - 1);
+		coords.resize(3*numPoints);
+		ids.resize(numPoints);
+		for(int id = 0; id < numPoints; id++)
+		{
+			int at = cursor[cellOf[id]]++;
+			const float *point = getPoint(id);
+			coords[3*at] = point[0];
+			coords[3*at+1] = point[1];
+			coords[3*at+2] = point[2];
+			ids[at] = id;
+		}
+	}
+
+	// Ids of the points within distanceTol of target appended to nearby, a radius above
+	// cellSize is answered too by looking further than the direct neighbours
+	void search(const float *target, float distanceTol, std::vector<int> &nearby) const
+	{
+		if(ids.empty())
+			return;
+		int reach = std::max(1, (int)ceilf(distanceTol / cellSize));
+		int cx = cellCoord(target[0]), cy = cellCoord(target[1]), cz = cellCoord(target[2]);
+		const float distanceTolSq = distanceTol*distanceTol;
+		for(int x = cx - reach; x <= cx + reach; x++)
+			for(int y = cy - reach; y <= cy + reach; y++)
+				for(int z = cz - reach; z <= cz + reach; z++)
+				{
+					int slot = findSlot(cellKey(x, y, z));
+					if(tableCell[slot] < 0)
+						continue;
+					int cell = tableCell[slot];
+					for(int at = cellBegin[cell]; at < cellBegin[cell+1]; at++)
+					{
+						const float *point = &coords[3*at];
+						float dx = point[0] - target[0], dy = point[1] - target[1], dz = point[2] - target[2];
+						if(dx*dx + dy*dy + dz*dz <= distanceTolSq)
+							nearby.push_back(ids[at]);
+					}
+				}
+	}
+
+	// Same interface as KdTree::search, missing coordinates are 0
+	std::vector<int> search(std::vector<float> target, float distanceTol) const
+	{
+		std::vector<int> nearby;
+		target.resize(3, 0.0f);
+		search(&target[0], distanceTol, nearby);
+		return nearby;
+	}
+
+	int size() const
+	{
+		return ids.size();
+	}
+
+	int numCells() const
+	{
+		return cellBegin.empty() ? 0 : cellBegin.size() - 1;
+	}
+
+private:
+
+	int cellCoord(float value) const
+	{
+		return (int)floorf(value / cellSize);
+	}
+
+	// 21 bits per axis, cells wrap around after about a million per axis
+	static uint64_t cellKey(int x, int y, int z)
+	{
+		return ((uint64_t)(x & 0x1fffff) << 42) | ((uint64_t)(y & 0x1fffff) << 21) | (uint64_t)(z & 0x1fffff);
+	}
+
+	// Slot of the open addressing table holding key or the empty slot where it goes
+	int findSlot(uint64_t key) const
+	{
+		int mask = tableCell.size() - 1;
+		int slot = (key * 0x9e3779b97f4a7c15ULL) >> 40 & mask;
+		while(tableCell[slot] >= 0 && tableKey[slot] != key)
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+
+	std::vector<uint64_t> tableKey;
+	std::vector<int> tableCell;
+	// build() scratch
+	std::vector<int> cellOf;
+	std::vector<int> cursor;
+};
+
+#endif /* VOXEL_HASH_INDEX_H */
@@ -7,15 +7,90 @@
 #include "processPointClouds.h"
 // using templates for processPointClouds so also include .cpp to help linker
 #include "processPointClouds.cpp"
+#include "pipeline/framePipeline.h"
+#include "pipeline/frameBatch.h"
+#include "io/boxWriter.h"
 #include <string>
+#include <thread>
 
 // Segmentation macros
 #define SEG_MAX_ITER 30
 #define SEG_THRESHOLD 0.35
+// PclRansac or NativeRansac (multithreaded, no allocation per frame once warm)
+#define PLANE_BACKEND PclRansac
+
+// Voxel size of FilterCloud
+#define GRID_SIZE 0.4
+// Region of interest kept by FilterCloud, LOAD_ROI 1 already drops everything outside it while the pcd is decoded
+#define ROI_MIN -10,-5,-2,1
+#define ROI_MAX 30,8,1,1
+// (the range image path then only sees the region too, the pre-converted stream index of PCD_LOADER 2 is not cropped)
+#define LOAD_ROI 1
+
+// FILTER_FUSED 1 crops, removes the roof and voxelizes in one pass with FilterCloudFused instead of PCL's filters
+#define FILTER_FUSED 0
+
+// Noise removal between filtering and segmentation, DENOISE 1 drops returns weaker than DENOISE_MIN_INTENSITY or
+// outside [DENOISE_MIN_RANGE, DENOISE_MAX_RANGE] m, then statistical outliers over DENOISE_MEAN_K neighbours
+#define DENOISE 0
+#define DENOISE_MIN_INTENSITY 0.01
+#define DENOISE_MIN_RANGE 2.0
+#define DENOISE_MAX_RANGE 50.0
+#define DENOISE_MEAN_K 8
+#define DENOISE_STDDEV_MUL 1.0
+#define DENOISE_RADIUS 0.6
+
+// Ground removal macros, GROUND_GRID 1 uses SegmentGround instead of a single RANSAC plane
+#define GROUND_GRID 0
+#define GROUND_BIN_SIZE 1.0
+#define GROUND_MAX_SLOPE 0.15
+
+// Range image macros, RANGE_IMAGE 1 segments and clusters the raw frame on an organized ring x azimuth grid
+// laid out like RANGE_IMAGE_PROFILE of the lidar profiles file instead of RANSAC and a kd-tree. Only the closest
+// return of every cell is clustered. The profiles file is found relative to the working directory, see loadRangeImageLayout
+#define RANGE_IMAGE 0
+#define RANGE_IMAGE_PROFILE "HDL-64"
+#define RANGE_IMAGE_PROFILES_FILE "../src/sensors/lidarProfiles.cfg"
+#define SENSOR_HEIGHT 1.73
 
 #define CLUSTER_MIN_SIZE 10
 #define CLUSTER_MAX_SIZE 500
 #define CLUSTER_TOLERANCE 0.53
+// PclKdTree, CustomKdTree, ReusedKdTree (updated with the delta between frames instead of rebuilt)
+// or VoxelHash (cells of CLUSTER_TOLERANCE)
+#define CLUSTER_BACKEND PclKdTree
+// ReusedKdTree only, also build a fresh kd-tree every frame to report the build time the reuse saves
+#define CLUSTER_MEASURE_SAVINGS 1
+
+// BOX_ORIENTED 1 fits yaw oriented boxes (BoxQ) instead of axis aligned ones
+#define BOX_ORIENTED 0
+
+// SOA_FRAME 1 loads every frame straight into SoaCloud columns and runs filter, plane segmentation,
+// clustering and boxes on them (always NativeRansac), the clouds are converted back only for rendering
+#define SOA_FRAME 0
+
+// Obstacle tracking over the boxes of consecutive frames, TRACKING_DT is the time between pcd files in seconds
+#define TRACKING 1
+#define TRACKING_DT 0.1
+
+// Pcd loading, 0 = pcl::io::loadPCDFile, 1 = memory mapped reader, 2 = pre-converted stream index
+#define PCD_LOADER 1
+
+// Frame pipeline macros, PIPELINE 1 runs loading and every cityBlock stage on its own thread
+#define PIPELINE 1
+#define PIPELINE_QUEUE_SIZE 4
+#define PIPELINE_REPORT_FRAMES 100
+
+// Latency histograms of every stage, frames over PROFILER_BUDGET_MS are flagged and everything is
+// written to PROFILER_OUTPUT (.json or .csv) on exit. PROFILER 0 leaves only a branch per timed scope.
+#define PROFILER 1
+#define PROFILER_BUDGET_MS 100
+#define PROFILER_OUTPUT "profile.json"
+// Heap allocations per frame and per stage are added to the report when utils/allocationCounter.cpp is
+// linked. Once the pooled clouds have grown to the biggest frame of the stream, which can take more than
+// one pass over it, a frame allocates nothing with FILTER_FUSED 1, PLANE_BACKEND NativeRansac,
+// CLUSTER_BACKEND CustomKdTree, ReusedKdTree or VoxelHash and PCD_LOADER 1 or 2 on one thread per call;
+// PCL's filters, RANSAC and kd-tree allocate inside PCL and every extra std::thread allocates its state.
 
 
 std::vector<Car> initHighway(bool renderScene, pcl::visualization::PCLVisualizer::Ptr& viewer)
@@ -94,49 +169,318 @@ void simpleHighway(pcl::visualization::PCLVisualizer::Ptr& viewer)
 }
 
 
-void cityBlock(pcl::visualization::PCLVisualizer::Ptr &viewer, ProcessPointClouds<pcl::PointXYZI>* processPntCld,
-               const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud )
+// With LOAD_ROI the loads of processPntCld only keep the region FilterCloud crops to, widened by a voxel:
+// PCL's FilterCloud voxelizes before it crops, and the voxels straddling the region border need all their
+// points for the same centroids. The fused and SoA filters crop first and drop the margin again.
+void setLoadRegion(ProcessPointClouds<pcl::PointXYZI>* processPntCld)
 {
+    const Eigen::Vector4f margin(GRID_SIZE, GRID_SIZE, GRID_SIZE, 0);
+    if(LOAD_ROI)
+        processPntCld->setLoadRegion(Eigen::Vector4f (ROI_MIN) - margin, Eigen::Vector4f (ROI_MAX) + margin);
+}
+
+
+// Loads frame.index of the stream with the loader selected by PCD_LOADER, into frame.soa.input with SOA_FRAME
+void loadFrame(ProcessPointClouds<pcl::PointXYZI>* processPntCld, const PcdStreamIndex<pcl::PointXYZI>& streamIndex,
+               Frame<pcl::PointXYZI>& frame)
+{
+    pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+    if(PCD_LOADER == 2 && streamIndex.size() > 0)
+    {
+        cloud = processPntCld->acquireCloud();
+        streamIndex.load(frame.index % streamIndex.size(), *cloud);
+    }
+    else if(PCD_LOADER == 1 && SOA_FRAME)
+    {
+        processPntCld->loadPcdMapped(frame.file, frame.soa.input);
+        return;
+    }
+    else if(PCD_LOADER == 1)
+        cloud = processPntCld->loadPcdMapped(frame.file);
+    else
+        cloud = processPntCld->loadPcd(frame.file);
+
+    if(SOA_FRAME)
+        frame.soa.input.fromCloud(*cloud);
+    else
+        frame.input = cloud;
+}
 
-    // std::string filePath = "../src/sensors/data/pcd/data_1/0000000000.pcd";
-    // pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloud = processPntCld->loadPcd(filePath);
-    //renderPointCloud(viewer, inputCloud, "Input Cloud");
 
-    const float GRID_SIZE = 0.4;
+// Points of the loaded frame whichever layout it was loaded into
+int inputSize(const Frame<pcl::PointXYZI>& frame)
+{
+    return SOA_FRAME ? frame.soa.input.size() : frame.input->points.size();
+}
+
+
+// Obstacle detection stages of cityBlock(), the frame pipeline runs each of them on its own thread
+void filterFrame(ProcessPointClouds<pcl::PointXYZI>* processPntCld, Frame<pcl::PointXYZI>& frame)
+{
     // Filtering the point cloud
-    pcl::PointCloud<pcl::PointXYZI>::Ptr filterCloud = processPntCld->FilterCloud(inputCloud, GRID_SIZE ,
-     Eigen::Vector4f (-10,-5,-2,1),
-     Eigen::Vector4f (30,8,1,1) );
+    if(SOA_FRAME)
+        processPntCld->FilterCloud(frame.soa.input, GRID_SIZE ,
+         Eigen::Vector4f (ROI_MIN),
+         Eigen::Vector4f (ROI_MAX), frame.soa.filtered );
+    else if(FILTER_FUSED)
+        frame.filtered = processPntCld->FilterCloudFused(frame.input, GRID_SIZE ,
+         Eigen::Vector4f (ROI_MIN),
+         Eigen::Vector4f (ROI_MAX) );
+    else
+        frame.filtered = processPntCld->FilterCloud(frame.input, GRID_SIZE ,
+         Eigen::Vector4f (ROI_MIN),
+         Eigen::Vector4f (ROI_MAX) );
+
+    // Removing weak returns and isolated points before they reach segmentation and clustering
+    if(DENOISE && SOA_FRAME)
+    {
+        processPntCld->DenoiseCloud(frame.soa.filtered, DENOISE_MIN_INTENSITY, DENOISE_MIN_RANGE, DENOISE_MAX_RANGE,
+                                    DENOISE_MEAN_K, DENOISE_STDDEV_MUL, DENOISE_RADIUS, frame.soa.denoised);
+        std::swap(frame.soa.filtered, frame.soa.denoised);
+    }
+    else if(DENOISE)
+        frame.filtered = processPntCld->DenoiseCloud(frame.filtered, DENOISE_MIN_INTENSITY, DENOISE_MIN_RANGE, DENOISE_MAX_RANGE,
+                                                     DENOISE_MEAN_K, DENOISE_STDDEV_MUL, DENOISE_RADIUS);
+}
+
+
+// Empty range image with the ring layout of the recorded sensor, set by loadRangeImageLayout
+RangeImage& rangeImageLayout()
+{
+    static RangeImage layout;
+    return layout;
+}
 
-    //renderPointCloud(viewer,filterCloud,"filterCloud");
 
+// Reads the ring layout of RANGE_IMAGE before any frame runs. A missing profile is fatal, an empty layout
+// would leave every point without a cell.
+bool loadRangeImageLayout()
+{
+    if(!RANGE_IMAGE)
+        return true;
+    LidarProfile profile;
+    if(!loadLidarProfile(RANGE_IMAGE_PROFILES_FILE, RANGE_IMAGE_PROFILE, profile) || profile.verticalAngles.empty())
+    {
+        std::cerr << "RANGE_IMAGE needs lidar profile " << RANGE_IMAGE_PROFILE << " from " << RANGE_IMAGE_PROFILES_FILE
+                  << ", relative to " << boost::filesystem::current_path().string() << std::endl;
+        return false;
+    }
+    rangeImageLayout().setRings(profile.verticalAngles, profile.horizontalResolution);
+    return true;
+}
+
+
+void segmentFrame(ProcessPointClouds<pcl::PointXYZI>* processPntCld, Frame<pcl::PointXYZI>& frame)
+{
     // Applying segmentation on the point cloud
-    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> \
-    segmentCloud = processPntCld->SegmentPlane(inputCloud, SEG_MAX_ITER, SEG_THRESHOLD);
+    if(SOA_FRAME)
+        processPntCld->SegmentPlane(frame.soa.filtered, SEG_MAX_ITER, SEG_THRESHOLD, frame.soa.obstacles, frame.soa.plane);
+    else if(RANGE_IMAGE)
+    {
+        frame.image = rangeImageLayout();
+        processPntCld->ProjectRangeImage(frame.input, frame.image);
+        frame.segmented = processPntCld->SegmentGroundImage(frame.input, frame.image, SENSOR_HEIGHT, SEG_THRESHOLD, GROUND_MAX_SLOPE);
+    }
+    else if(GROUND_GRID)
+        frame.segmented = processPntCld->SegmentGround(frame.filtered, GROUND_BIN_SIZE, SEG_THRESHOLD, GROUND_MAX_SLOPE);
+    else
+        frame.segmented = processPntCld->SegmentPlane(frame.filtered, SEG_MAX_ITER, SEG_THRESHOLD, PLANE_BACKEND);
+}
 
-    renderPointCloud(viewer,segmentCloud.first,"obstCloud",Color(1,0,0));
-    renderPointCloud(viewer,segmentCloud.second,"planeCloud",Color(0,0,1));
-    
+
+void clusterFrame(ProcessPointClouds<pcl::PointXYZI>* processPntCld, Frame<pcl::PointXYZI>& frame)
+{
     // Applying Clustering on the point cloud
-    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters = \ 
-    processPntCld->Clustering(segmentCloud.first,CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE);
+    if(SOA_FRAME)
+        processPntCld->Clustering(frame.soa.obstacles, CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, frame.soa.clusters, CLUSTER_BACKEND);
+    else if(RANGE_IMAGE)
+        processPntCld->ClusteringImage(frame.input, frame.image, CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, frame.clusters, GRID_SIZE);
+    else
+        processPntCld->Clustering(frame.segmented.first,CLUSTER_TOLERANCE, CLUSTER_MIN_SIZE, CLUSTER_MAX_SIZE, frame.clusters, CLUSTER_BACKEND);
+}
+
+
+void boxFrame(ProcessPointClouds<pcl::PointXYZI>* processPntCld, Frame<pcl::PointXYZI>& frame)
+{
+    frame.boxes.clear();
+    if(SOA_FRAME)
+        for(int cluster = 0; cluster < frame.soa.clusters.size(); cluster++)
+            frame.boxes.push_back(processPntCld->BoundingBox(frame.soa.clusters, cluster));
+    else if(BOX_ORIENTED)
+        processPntCld->BoundingBoxQ(frame.clusters, frame.boxesQ);
+    else
+        for(int cluster = 0; cluster < frame.clusters.size(); cluster++)
+            frame.boxes.push_back(processPntCld->BoundingBox(frame.clusters, cluster));
+}
+
+
+// Tracks must see the frames in stream order, so this runs on a single thread after boxFrame
+void trackFrame(Tracker* tracker, Frame<pcl::PointXYZI>& frame, int streamSize)
+{
+    frame.detections.clear();
+    for(const Box& box : frame.boxes)
+        frame.detections.push_back(toBoxRecord(box));
+    for(const BoxQ& box : frame.boxesQ)
+        frame.detections.push_back(toBoxRecord(box));
+
+    // playback wrapped around, the old tracks belong to the end of the stream
+    if(frame.index % streamSize == 0)
+        tracker->clear();
+    tracker->update(frame.detections, TRACKING_DT);
+    tracker->confirmedTracks(frame.tracks);
+}
+
+
+void renderFrame(pcl::visualization::PCLVisualizer::Ptr &viewer, const Frame<pcl::PointXYZI>& frame)
+{
+    //renderPointCloud(viewer,frame.filtered,"filterCloud");
+
+    // The viewer only draws pcl clouds, SoA frames are converted here outside the timed stages
+    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmented = frame.segmented;
+    ClusterSet<pcl::PointXYZI> soaClusters;
+    if(SOA_FRAME)
+    {
+        segmented.first.reset(new pcl::PointCloud<pcl::PointXYZI>);
+        segmented.second.reset(new pcl::PointCloud<pcl::PointXYZI>);
+        frame.soa.obstacles.toCloud(*segmented.first);
+        frame.soa.plane.toCloud(*segmented.second);
+        frame.soa.clusters.toClusterSet(soaClusters);
+    }
+
+    renderPointCloud(viewer,segmented.first,"obstCloud",Color(1,0,0));
+    renderPointCloud(viewer,segmented.second,"planeCloud",Color(0,0,1));
 
     std::vector<Color> colors = {Color(1,1,1), Color(0,1,0), Color(1,1,0)};
-    short colorId = 0;
-    for(pcl::PointCloud<pcl::PointXYZI>::Ptr cluster: cloudClusters){
+    renderClusters(viewer, SOA_FRAME ? soaClusters : frame.clusters, "Clusters", colors);
+    for(short colorId = 0; colorId < (int)frame.boxes.size(); colorId++){
 
-        // std::cout << "Cluster size: " << processPntCld.numPoints(cluster) << std::endl;
-        renderPointCloud(viewer, cluster, "Cluster " + std::to_string(colorId), colors[colorId % 3]);
         // Rendering a box 
-        Box box = processPntCld->BoundingBox(cluster);
-        renderBox(viewer,box,colorId);
-        colorId++;
+        renderBox(viewer,frame.boxes[colorId],colorId);
+    }
+    for(short colorId = 0; colorId < (int)frame.boxesQ.size(); colorId++)
+        renderBox(viewer,frame.boxesQ[colorId],colorId);
+
+    // Track ids above their boxes
+    for(const TrackState& track : frame.tracks)
+    {
+        pcl::PointXYZ position(track.x, track.y, track.z + track.height/2 + 0.5);
+        viewer->addText3D(std::to_string(track.id), position, 0.5, 1, 1, 1, "track"+std::to_string(track.id));
+    }
+}
+
+
+// frame holds the loaded input and is reused from one file to the next, so its buffers keep their capacity
+void cityBlock(pcl::visualization::PCLVisualizer::Ptr &viewer, ProcessPointClouds<pcl::PointXYZI>* processPntCld,
+               Frame<pcl::PointXYZI>& frame, Tracker* tracker, int streamSize )
+{
+
+    // std::string filePath = "../src/sensors/data/pcd/data_1/0000000000.pcd";
+    // pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloud = processPntCld->loadPcd(filePath);
+    //renderPointCloud(viewer, inputCloud, "Input Cloud");
+
+    {
+        PROFILE_ALLOCATIONS("cityBlock allocations");
+        filterFrame(processPntCld, frame);
+        segmentFrame(processPntCld, frame);
+        clusterFrame(processPntCld, frame);
+        boxFrame(processPntCld, frame);
+        if(TRACKING)
+            trackFrame(tracker, frame, streamSize);
     }
 
+    renderFrame(viewer, frame);
 
 }
 
 
+// The stream index of PCD_LOADER 2 is built beside the pcd directory on first use and mapped on every later run,
+// it is rebuilt when a frame was added, removed or rewritten since
+void openStreamIndex(const std::string& dataPath, const std::vector<boost::filesystem::path>& stream, PcdStreamIndex<pcl::PointXYZI>& streamIndex)
+{
+    if(PCD_LOADER != 2)
+        return;
+    std::string indexFile = PcdStreamIndex<pcl::PointXYZI>::indexPath(dataPath);
+    if(!streamIndex.open(indexFile) || !streamIndex.matches(stream))
+    {
+        std::cout << "building stream index " << indexFile << std::endl;
+        PcdStreamIndex<pcl::PointXYZI>::build(stream, indexFile);
+        streamIndex.open(indexFile);
+    }
+}
+
+
+// cityBlock over every frame of dataPath once, without a viewer. Whole frames run in parallel on a
+// work stealing pool with a ProcessPointClouds per worker, the boxes of every frame go to outputFile in stream order.
+int runHeadless(const std::string& dataPath, const std::string& outputFile, int numThreads)
+{
+    ProcessPointClouds<pcl::PointXYZI> streamProcessor;
+    std::vector<boost::filesystem::path> stream = streamProcessor.streamPcd(dataPath);
+    PcdStreamIndex<pcl::PointXYZI> streamIndex;
+    openStreamIndex(dataPath, stream, streamIndex);
+
+    BoxWriter writer;
+    if(!outputFile.empty() && !writer.open(outputFile))
+        return 1;
+
+    // slow frames are only counted, the profile written at exit lists them
+    Profiler::instance().setVerbose(false);
+    ThreadPool pool(numThreads);
+    std::vector<ProcessPointClouds<pcl::PointXYZI>> processors(pool.size());
+    for(ProcessPointClouds<pcl::PointXYZI>& processor : processors)
+    {
+        processor.setVerbose(false);
+        processor.setNumThreads(1);
+        setLoadRegion(&processor);
+    }
+
+    long numPoints = 0, numBoxes = 0;
+    std::vector<BoxRecord> boxes;
+    auto startTime = std::chrono::steady_clock::now();
+
+    FrameBatch<pcl::PointXYZI> batch(pool);
+    batch.run(stream,
+        [&processors, &streamIndex](int worker, Frame<pcl::PointXYZI>& frame)
+        {
+            PROFILE_FRAME(frame.index);
+            ProcessPointClouds<pcl::PointXYZI>* processor = &processors[worker];
+            loadFrame(processor, streamIndex, frame);
+            filterFrame(processor, frame);
+            segmentFrame(processor, frame);
+            clusterFrame(processor, frame);
+            boxFrame(processor, frame);
+        },
+        [&](Frame<pcl::PointXYZI>& frame)
+        {
+            boxes.clear();
+            for(const Box& box : frame.boxes)
+                boxes.push_back(toBoxRecord(box));
+            for(const BoxQ& box : frame.boxesQ)
+                boxes.push_back(toBoxRecord(box));
+            writer.write(frame.index, boxes);
+            numPoints += inputSize(frame);
+            numBoxes += boxes.size();
+        });
+    writer.close();
+
+    if(DENOISE)
+    {
+        long gated = 0, outliers = 0;
+        for(const ProcessPointClouds<pcl::PointXYZI>& processor : processors)
+        {
+            gated += processor.denoiseStats().gated;
+            outliers += processor.denoiseStats().outliers;
+        }
+        std::cout << "denoise: " << gated << " points gated and " << outliers << " outliers removed before segmentation" << std::endl;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "headless: " << stream.size() << " frames, " << numPoints << " points, " << numBoxes << " boxes in " << seconds
+              << " s on " << pool.size() << " threads, " << stream.size()/std::max(seconds, 1e-9) << " frames/s, "
+              << numPoints/std::max(seconds, 1e-9)/1e6 << " Mpoints/s" << std::endl;
+    return 0;
+}
+
+
 //setAngle: SWITCH CAMERA ANGLE {XY, TopDown, Side, FPS}
 void initCamera(CameraAngle setAngle, pcl::visualization::PCLVisualizer::Ptr& viewer)
 {
@@ -163,6 +507,19 @@ void initCamera(CameraAngle setAngle, pcl::visualization::PCLVisualizer::Ptr& vi
 
 int main (int argc, char** argv)
 {
+    Profiler::instance().enable(PROFILER);
+    Profiler::instance().setFrameBudget(PROFILER_BUDGET_MS);
+    Profiler::instance().dumpOnExit(PROFILER_OUTPUT);
+    if(!loadRangeImageLayout())
+        return 1;
+
+    // usage: environment [--headless <pcdDir> [boxes.csv|boxes.bin] [threads]]
+    if(argc > 2 && std::string(argv[1]) == "--headless")
+    {
+        int numThreads = (argc > 4) ? std::stoi(argv[4]) : std::thread::hardware_concurrency();
+        return runHeadless(argv[2], (argc > 3) ? argv[3] : "", std::max(numThreads, 1));
+    }
+
     std::cout << "starting enviroment" << std::endl;
 
     pcl::visualization::PCLVisualizer::Ptr viewer (new pcl::visualization::PCLVisualizer ("3D Viewer"));
@@ -173,8 +530,60 @@ int main (int argc, char** argv)
     std::string filePath = "../src/sensors/data/pcd/data_1";
     ProcessPointClouds<pcl::PointXYZI> *pointProcessorI = new ProcessPointClouds<pcl::PointXYZI>();
     std::vector<boost::filesystem::path> stream = pointProcessorI->streamPcd(filePath);
+
+    PcdStreamIndex<pcl::PointXYZI> streamIndex;
+    openStreamIndex(filePath, stream, streamIndex);
+
+    if(PIPELINE)
+    {
+        // Every stage owns a ProcessPointClouds so their scratch buffers are never shared between threads
+        ProcessPointClouds<pcl::PointXYZI> loadProcessor, filterProcessor, segmentProcessor, clusterProcessor, boxProcessor;
+        clusterProcessor.setMeasureIndexSavings(CLUSTER_MEASURE_SAVINGS);
+        setLoadRegion(&loadProcessor);
+
+        FramePipeline<pcl::PointXYZI> pipeline(PIPELINE_QUEUE_SIZE);
+        pipeline.addStage("load", [&loadProcessor, &streamIndex](Frame<pcl::PointXYZI>& frame){ loadFrame(&loadProcessor, streamIndex, frame); });
+        pipeline.addStage("filter", [&filterProcessor](Frame<pcl::PointXYZI>& frame){ filterFrame(&filterProcessor, frame); });
+        pipeline.addStage("segment", [&segmentProcessor](Frame<pcl::PointXYZI>& frame){ segmentFrame(&segmentProcessor, frame); });
+        pipeline.addStage("cluster", [&clusterProcessor](Frame<pcl::PointXYZI>& frame){ clusterFrame(&clusterProcessor, frame); });
+        pipeline.addStage("box", [&boxProcessor](Frame<pcl::PointXYZI>& frame){ boxFrame(&boxProcessor, frame); });
+        // a single stage thread keeps the frames in order for the tracker
+        Tracker tracker;
+        if(TRACKING)
+            pipeline.addStage("track", [&tracker, &stream](Frame<pcl::PointXYZI>& frame){ trackFrame(&tracker, frame, stream.size()); });
+        pipeline.start(stream, true);
+
+        // The viewer renders finished frames while the next ones are being processed
+        Frame<pcl::PointXYZI> frame;
+        while (!viewer->wasStopped () && pipeline.next(frame))
+        {
+            // Clear viewer
+            viewer->removeAllPointClouds();
+            viewer->removeAllShapes();
+
+            renderFrame(viewer, frame);
+            viewer->spinOnce ();
+
+            if((frame.index+1) % PIPELINE_REPORT_FRAMES == 0)
+                pipeline.printStats();
+        }
+
+        pipeline.stop();
+        pipeline.printStats();
+        // the cluster stage is stopped, its counters can be read
+        if(CLUSTER_BACKEND == ReusedKdTree)
+            clusterProcessor.printIndexStats();
+        if(DENOISE)
+            filterProcessor.printDenoiseStats();
+        return 0;
+    }
+
     auto streamIter = stream.begin();
-    pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloudI;
+    Frame<pcl::PointXYZI> frame;
+    pointProcessorI->setMeasureIndexSavings(CLUSTER_MEASURE_SAVINGS);
+    setLoadRegion(pointProcessorI);
+    long frameCount = 0;
+    Tracker tracker;
 
     while (!viewer->wasStopped ())
     {
@@ -183,13 +592,29 @@ int main (int argc, char** argv)
         viewer->removeAllShapes();
 
         // Load pcd and run obstacle detection process
-        inputCloudI = pointProcessorI->loadPcd((*streamIter).string());
-        cityBlock(viewer, pointProcessorI, inputCloudI);
+        {
+            PROFILE_FRAME(frameCount);
+            {
+                PROFILE_ALLOCATIONS("load allocations");
+                // the previous input goes back to the pool and takes the new file
+                frame.input.reset();
+                frame.index = streamIter - stream.begin();
+                frame.file = streamIter->native();
+                loadFrame(pointProcessorI, streamIndex, frame);
+            }
+            cityBlock(viewer, pointProcessorI, frame, &tracker, stream.size());
+        }
+        frameCount++;
 
         streamIter++;
         if(streamIter == stream.end())
             streamIter = stream.begin();
 
+        if(CLUSTER_BACKEND == ReusedKdTree && frameCount % PIPELINE_REPORT_FRAMES == 0)
+            pointProcessorI->printIndexStats();
+        if(DENOISE && frameCount % PIPELINE_REPORT_FRAMES == 0)
+            pointProcessorI->printDenoiseStats();
+
         viewer->spinOnce ();
     } 
 }
\ No newline at end of file
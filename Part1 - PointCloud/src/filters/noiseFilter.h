@@ -0,0 +1,165 @@
+// Noise removal ahead of plane segmentation: intensity and range gating of single returns, then
+// statistical outlier removal of the isolated points that survive. Rain, dust and low reflectivity
+// speckle otherwise reach the clustering, where every point costs a radius search.
+
+#ifndef NOISE_FILTER_H
+#define NOISE_FILTER_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../utils/soaCloud.h"
+#include "../cluster/voxelHashIndex.h"
+
+// mask[i] = 1 for points with intensity >= minIntensity (intensity may be NULL) and a distance to
+// the sensor in [minRange, maxRange], 0 for the others. Returns the number of points kept.
+inline int gateMask(const float *x, const float *y, const float *z, const float *intensity, int numPoints,
+                    float minIntensity, float minRange, float maxRange, uint8_t *mask)
+{
+	const float minRangeSq = minRange*minRange, maxRangeSq = maxRange*maxRange;
+	int count = 0;
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 low = _mm_set1_ps(minRangeSq), high = _mm_set1_ps(maxRangeSq), weakest = _mm_set1_ps(minIntensity);
+	for(; i + 4 <= numPoints; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		__m128 rangeSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+		__m128 keep = _mm_and_ps(_mm_cmpge_ps(rangeSq, low), _mm_cmple_ps(rangeSq, high));
+		if(intensity)
+			keep = _mm_and_ps(keep, _mm_cmpge_ps(_mm_loadu_ps(intensity + i), weakest));
+		int bits = _mm_movemask_ps(keep);
+		mask[i] = bits & 1;
+		mask[i+1] = (bits >> 1) & 1;
+		mask[i+2] = (bits >> 2) & 1;
+		mask[i+3] = (bits >> 3) & 1;
+		count += mask[i] + mask[i+1] + mask[i+2] + mask[i+3];
+	}
+#endif
+	for(; i < numPoints; i++)
+	{
+		float rangeSq = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+		mask[i] = rangeSq >= minRangeSq && rangeSq <= maxRangeSq && (!intensity || intensity[i] >= minIntensity);
+		count += mask[i];
+	}
+	return count;
+}
+
+// Reusable frame after frame, filter() keeps the capacity of every buffer
+template<typename PointT>
+struct NoiseFilter
+{
+	// returns weaker than this are dropped, point types without intensity are never gated on it
+	float minIntensity;
+	// distance to the sensor, closer returns are the ego vehicle and spray, farther ones too sparse to trust
+	float minRange, maxRange;
+	// Statistical outlier removal like pcl::StatisticalOutlierRemoval: the mean distance of a point to its
+	// meanK nearest neighbours is compared with mean + stddevMul * stddev over the frame. Neighbours are
+	// looked up in a voxel hash within searchRadius, missing ones count as searchRadius away.
+	// meanK 0 disables it.
+	int meanK;
+	float stddevMul;
+	float searchRadius;
+	// points the last filter() call dropped by the gate and as outliers
+	int gated, outliers;
+
+	NoiseFilter()
+	: minIntensity(0), minRange(0), maxRange(1000), meanK(8), stddevMul(1), searchRadius(1), gated(0), outliers(0)
+	{}
+
+	// output is replaced with the points of input that pass the gate and are no outliers, in input order
+	void filter(const SoaCloud<PointT> &input, SoaCloud<PointT> &output)
+	{
+		int numPoints = input.size();
+		output.clear();
+		gated = outliers = 0;
+		if(numPoints == 0)
+			return;
+
+		mask.resize(numPoints);
+		int numKept = gateMask(&input.x[0], &input.y[0], &input.z[0], input.hasIntensity() ? &input.intensity[0] : NULL, numPoints,
+		                       minIntensity, minRange, maxRange, &mask[0]);
+		gated = numPoints - numKept;
+		if(meanK <= 0 || numKept == 0)
+		{
+			output.select(input, &mask[0], 1);
+			return;
+		}
+
+		kept.clear();
+		kept.select(input, &mask[0], 1);
+		markOutliers(kept);
+		output.select(kept, &mask[0], 1);
+		outliers = numKept - output.size();
+	}
+
+private:
+
+	// mask[i] = 1 for the points of cloud that are no outliers
+	void markOutliers(const SoaCloud<PointT> &cloud)
+	{
+		int numPoints = cloud.size();
+		packed.resize(3*numPoints);
+		for(int i = 0; i < numPoints; i++)
+		{
+			packed[3*i] = cloud.x[i];
+			packed[3*i+1] = cloud.y[i];
+			packed[3*i+2] = cloud.z[i];
+		}
+		const float *points = packed.data();
+		index.build([points](int id){ return points + 3*id; }, numPoints, searchRadius);
+
+		meanDistance.resize(numPoints);
+		double sum = 0, sumSq = 0;
+		for(int i = 0; i < numPoints; i++)
+		{
+			const float *target = points + 3*i;
+			nearby.clear();
+			index.search(target, searchRadius, nearby);
+			// squared distances, the root is only taken of the k nearest
+			distances.clear();
+			for(int id : nearby)
+			{
+				if(id == i)
+					continue;
+				const float *point = points + 3*id;
+				float dx = point[0] - target[0], dy = point[1] - target[1], dz = point[2] - target[2];
+				distances.push_back(dx*dx + dy*dy + dz*dz);
+			}
+
+			int k = std::min<int>(meanK, distances.size());
+			if(k > 0 && k < (int)distances.size())
+				std::nth_element(distances.begin(), distances.begin() + k - 1, distances.end());
+			float total = (meanK - k)*searchRadius;
+			for(int n = 0; n < k; n++)
+				total += sqrtf(distances[n]);
+			meanDistance[i] = total / meanK;
+			sum += meanDistance[i];
+			sumSq += meanDistance[i]*meanDistance[i];
+		}
+
+		double mean = sum / numPoints;
+		double variance = std::max(0.0, sumSq / numPoints - mean*mean);
+		float threshold = mean + stddevMul*sqrt(variance);
+		mask.resize(numPoints);
+		for(int i = 0; i < numPoints; i++)
+			mask[i] = meanDistance[i] <= threshold;
+	}
+
+	VoxelHashIndex<PointT> index;
+	// gate result, then outlier result
+	std::vector<uint8_t> mask;
+	// points that passed the gate
+	SoaCloud<PointT> kept;
+	// markOutliers() scratch
+	std::vector<float> packed;
+	std::vector<float> meanDistance;
+	std::vector<int> nearby;
+	std::vector<float> distances;
+};
+
+#endif /* NOISE_FILTER_H */
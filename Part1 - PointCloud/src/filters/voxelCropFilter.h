@@ -0,0 +1,231 @@
+// Region crop, ego roof removal and voxel grid downsampling fused in a single pass
+
+#ifndef VOXEL_CROP_FILTER_H
+#define VOXEL_CROP_FILTER_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../utils/pointTraits.h"
+#include "../utils/soaCloud.h"
+
+// Sum of the points that fell into one voxel
+struct VoxelSum
+{
+	float x, y, z, intensity;
+	int count;
+};
+
+// Points outside [minPoint, maxPoint] or inside the roof box are dropped before they are hashed,
+// the survivors are averaged per voxel like pcl::VoxelGrid, intensity included when the point has one.
+// The hash table and voxel sums are members reused across frames, so the output cloud is the only
+// allocation of a frame.
+template<typename PointT>
+struct VoxelCropFilter
+{
+	float leafSize;
+	// boxes as x, y, z, kept as plain arrays so the filter can live inside heap allocated objects
+	float minPoint[3], maxPoint[3];
+	// points inside the roof box are returns from the ego vehicle, an empty box (min > max) disables it
+	float roofMin[3], roofMax[3];
+
+	// open addressing table of voxel keys, slot holds an index into sums or -1
+	std::vector<uint64_t> keys;
+	std::vector<int> slots;
+	std::vector<VoxelSum> sums;
+
+	VoxelCropFilter()
+	: leafSize(0.2)
+	{
+		setRegion(Eigen::Vector4f(-1,-1,-1,1), Eigen::Vector4f(1,1,1,1));
+		setRoof(Eigen::Vector4f(1,1,1,1), Eigen::Vector4f(-1,-1,-1,1));
+	}
+
+	void setRegion(const Eigen::Vector4f &setMin, const Eigen::Vector4f &setMax)
+	{
+		for(int axis = 0; axis < 3; axis++)
+		{
+			minPoint[axis] = setMin[axis];
+			maxPoint[axis] = setMax[axis];
+		}
+	}
+
+	void setRoof(const Eigen::Vector4f &setMin, const Eigen::Vector4f &setMax)
+	{
+		for(int axis = 0; axis < 3; axis++)
+		{
+			roofMin[axis] = setMin[axis];
+			roofMax[axis] = setMax[axis];
+		}
+	}
+
+	bool inside(const PointT &point, const float *boxMin, const float *boxMax) const
+	{
+		return point.x >= boxMin[0] && point.x <= boxMax[0] &&
+		       point.y >= boxMin[1] && point.y <= boxMax[1] &&
+		       point.z >= boxMin[2] && point.z <= boxMax[2];
+	}
+
+	// 21 bits per axis. Voxels are aligned to floor(x / leaf) like pcl::VoxelGrid and counted from the
+	// voxel of the region minimum, so all keys are positive and the cells match PCL's wherever the region starts.
+	uint64_t voxelKey(float x, float y, float z, float inverseLeaf) const
+	{
+		uint64_t ix = (uint64_t)((int64_t)floorf(x * inverseLeaf) - (int64_t)floorf(minPoint[0] * inverseLeaf));
+		uint64_t iy = (uint64_t)((int64_t)floorf(y * inverseLeaf) - (int64_t)floorf(minPoint[1] * inverseLeaf));
+		uint64_t iz = (uint64_t)((int64_t)floorf(z * inverseLeaf) - (int64_t)floorf(minPoint[2] * inverseLeaf));
+		return (ix & 0x1FFFFF) | ((iy & 0x1FFFFF) << 21) | ((iz & 0x1FFFFF) << 42);
+	}
+
+	static uint64_t hashKey(uint64_t key)
+	{
+		key ^= key >> 33;
+		key *= 0xFF51AFD7ED558CCDull;
+		key ^= key >> 33;
+		return key;
+	}
+
+	void filter(const pcl::PointCloud<PointT> &input, pcl::PointCloud<PointT> &output)
+	{
+		int numPoints = input.points.size();
+		float inverseLeaf = 1.0f / leafSize;
+		size_t tableSize = clearTable(numPoints);
+
+		for(int i = 0; i < numPoints; i++)
+		{
+			const PointT &point = input.points[i];
+			if(!inside(point, minPoint, maxPoint) || inside(point, roofMin, roofMax))
+				continue;
+			accumulate(point.x, point.y, point.z, PointTraits<PointT>::intensity(point), inverseLeaf, tableSize);
+		}
+
+		output.points.resize(sums.size());
+		for(size_t voxel = 0; voxel < sums.size(); voxel++)
+		{
+			const VoxelSum &sum = sums[voxel];
+			float inverseCount = 1.0f / sum.count;
+			PointT &point = output.points[voxel];
+			point.x = sum.x * inverseCount;
+			point.y = sum.y * inverseCount;
+			point.z = sum.z * inverseCount;
+			PointTraits<PointT>::setIntensity(point, sum.intensity * inverseCount);
+		}
+		output.width = output.points.size();
+		output.height = 1;
+		output.is_dense = true;
+	}
+
+	// Same filter over SoA columns: the crop runs as a vectorized mask pass over x, y and z,
+	// only the kept points are hashed. output is replaced and keeps its capacity.
+	void filter(const SoaCloud<PointT> &input, SoaCloud<PointT> &output)
+	{
+		int numPoints = input.size();
+		float inverseLeaf = 1.0f / leafSize;
+		size_t tableSize = clearTable(numPoints);
+		cropMask.resize(numPoints);
+		if(numPoints > 0)
+			maskCrop(&input.x[0], &input.y[0], &input.z[0], numPoints, &cropMask[0]);
+
+		for(int i = 0; i < numPoints; i++)
+			if(cropMask[i])
+				accumulate(input.x[i], input.y[i], input.z[i], input.hasIntensity() ? input.intensity[i] : 0.0f, inverseLeaf, tableSize);
+
+		output.resize(sums.size());
+		for(size_t voxel = 0; voxel < sums.size(); voxel++)
+		{
+			const VoxelSum &sum = sums[voxel];
+			float inverseCount = 1.0f / sum.count;
+			output.x[voxel] = sum.x * inverseCount;
+			output.y[voxel] = sum.y * inverseCount;
+			output.z[voxel] = sum.z * inverseCount;
+			if(output.hasIntensity())
+				output.intensity[voxel] = sum.intensity * inverseCount;
+		}
+	}
+
+private:
+
+	// Empty table for numPoints points, power of two and at most half full, returns its size
+	size_t clearTable(int numPoints)
+	{
+		size_t tableSize = 16;
+		while(tableSize < 2*(size_t)numPoints)
+			tableSize <<= 1;
+		if(slots.size() < tableSize)
+		{
+			keys.resize(tableSize);
+			slots.resize(tableSize);
+		}
+		std::fill(slots.begin(), slots.end(), -1);
+		sums.clear();
+		sums.reserve(numPoints);
+		return slots.size();
+	}
+
+	void accumulate(float x, float y, float z, float intensity, float inverseLeaf, size_t tableSize)
+	{
+		uint64_t key = voxelKey(x, y, z, inverseLeaf);
+		size_t slot = hashKey(key) & (tableSize - 1);
+		while(slots[slot] != -1 && keys[slot] != key)
+			slot = (slot + 1) & (tableSize - 1);
+
+		if(slots[slot] == -1)
+		{
+			keys[slot] = key;
+			slots[slot] = sums.size();
+			VoxelSum sum = {0, 0, 0, 0, 0};
+			sums.push_back(sum);
+		}
+
+		VoxelSum &sum = sums[slots[slot]];
+		sum.x += x;
+		sum.y += y;
+		sum.z += z;
+		sum.intensity += intensity;
+		sum.count++;
+	}
+
+	// mask[i] = 1 for the points inside the region and outside the roof
+	void maskCrop(const float *x, const float *y, const float *z, int numPoints, uint8_t *mask) const
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		const __m128 regionMin[3] = {_mm_set1_ps(minPoint[0]), _mm_set1_ps(minPoint[1]), _mm_set1_ps(minPoint[2])};
+		const __m128 regionMax[3] = {_mm_set1_ps(maxPoint[0]), _mm_set1_ps(maxPoint[1]), _mm_set1_ps(maxPoint[2])};
+		const __m128 boxMin[3] = {_mm_set1_ps(roofMin[0]), _mm_set1_ps(roofMin[1]), _mm_set1_ps(roofMin[2])};
+		const __m128 boxMax[3] = {_mm_set1_ps(roofMax[0]), _mm_set1_ps(roofMax[1]), _mm_set1_ps(roofMax[2])};
+		for(; i + 4 <= numPoints; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+			__m128 inRegion = _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px, regionMin[0]), _mm_cmple_ps(px, regionMax[0])),
+			                                        _mm_and_ps(_mm_cmpge_ps(py, regionMin[1]), _mm_cmple_ps(py, regionMax[1]))),
+			                             _mm_and_ps(_mm_cmpge_ps(pz, regionMin[2]), _mm_cmple_ps(pz, regionMax[2])));
+			__m128 onRoof = _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px, boxMin[0]), _mm_cmple_ps(px, boxMax[0])),
+			                                      _mm_and_ps(_mm_cmpge_ps(py, boxMin[1]), _mm_cmple_ps(py, boxMax[1]))),
+			                           _mm_and_ps(_mm_cmpge_ps(pz, boxMin[2]), _mm_cmple_ps(pz, boxMax[2])));
+			int bits = _mm_movemask_ps(_mm_andnot_ps(onRoof, inRegion));
+			mask[i] = bits & 1;
+			mask[i+1] = (bits >> 1) & 1;
+			mask[i+2] = (bits >> 2) & 1;
+			mask[i+3] = (bits >> 3) & 1;
+		}
+#endif
+		for(; i < numPoints; i++)
+		{
+			bool inRegion = x[i] >= minPoint[0] && x[i] <= maxPoint[0] && y[i] >= minPoint[1] && y[i] <= maxPoint[1] &&
+			                z[i] >= minPoint[2] && z[i] <= maxPoint[2];
+			bool onRoof = x[i] >= roofMin[0] && x[i] <= roofMax[0] && y[i] >= roofMin[1] && y[i] <= roofMax[1] &&
+			              z[i] >= roofMin[2] && z[i] <= roofMax[2];
+			mask[i] = inRegion && !onRoof;
+		}
+	}
+
+	// crop result of the SoA filter
+	std::vector<uint8_t> cropMask;
+};
+
+#endif /* VOXEL_CROP_FILTER_H */
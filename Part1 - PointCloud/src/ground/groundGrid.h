@@ -0,0 +1,161 @@
+// Ground segmentation on a polar grid, local ground heights per cell instead of one global plane
+
+#ifndef GROUND_GRID_H
+#define GROUND_GRID_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+// Points are binned by azimuth into sectors and by range into bins along each sector.
+// Walking a sector outwards, the lowest point of a bin is accepted as the local ground height
+// when it is reachable from the previous ground height within maxSlope, otherwise the bin is
+// assumed to be covered by an obstacle and the previous height is carried on.
+// Every step is linear in the number of points and sectors are processed in parallel.
+struct GroundGrid
+{
+	int numSectors;
+	float binSize;
+	float maxRange;
+	// points up to heightThreshold above the local ground are ground
+	float heightThreshold;
+	// allowed ground rise per meter of range
+	float maxSlope;
+	int numThreads;
+
+	// cell (sector*numBins + bin) of every point
+	std::vector<int> cellOf;
+	// point ids grouped by sector, sector s is sectorPoints[sectorOffsets[s], sectorOffsets[s+1])
+	std::vector<int> sectorPoints;
+	std::vector<int> sectorOffsets;
+	// lowest z and accepted ground height per cell
+	std::vector<float> cellMinZ;
+	std::vector<float> cellGround;
+	std::vector<char> isGround;
+	// scatter cursors and lowest points of the near bins, kept for their capacity
+	std::vector<int> fill;
+	std::vector<float> nearMinZ;
+
+	GroundGrid()
+	: numSectors(180), binSize(1.0), maxRange(80), heightThreshold(0.3), maxSlope(0.15),
+	  numThreads(std::max(1u, std::thread::hardware_concurrency()))
+	{}
+
+	int numBins() const
+	{
+		return (int)ceil(maxRange / binSize);
+	}
+
+	// Run fn(begin, end) over [0, count) split in numThreads contiguous chunks
+	template<typename Fn>
+	void parallelFor(int count, Fn fn) const
+	{
+		int threadsUsed = std::max(1, std::min(numThreads, count));
+		int chunk = (count + threadsUsed - 1) / threadsUsed;
+		std::vector<std::thread> threads;
+		for(int t = 1; t < threadsUsed; t++)
+			threads.push_back(std::thread(fn, std::min(count, t*chunk), std::min(count, (t+1)*chunk)));
+		fn(0, std::min(count, chunk));
+		for(std::thread &thread : threads)
+			thread.join();
+	}
+
+	// points: any container of PCL-like points, e.g. pcl::PointCloud<PointT>::points
+	// Fills ground with the ids of ground points in input order.
+	template<typename Points>
+	void segment(const Points& points, std::vector<int> &ground)
+	{
+		int numPoints = points.size();
+		int bins = numBins();
+		const float sectorScale = numSectors / (2*M_PI);
+
+		// Cell of every point
+		cellOf.resize(numPoints);
+		parallelFor(numPoints, [&](int begin, int end)
+		{
+			for(int i = begin; i < end; i++)
+			{
+				float range = sqrtf(points[i].x*points[i].x + points[i].y*points[i].y);
+				int sector = (int)((atan2f(points[i].y, points[i].x) + M_PI) * sectorScale);
+				int bin = (int)(range / binSize);
+				cellOf[i] = std::min(sector, numSectors-1)*bins + std::min(bin, bins-1);
+			}
+		});
+
+		// Counting sort of point ids by sector
+		sectorOffsets.assign(numSectors+1, 0);
+		for(int i = 0; i < numPoints; i++)
+			sectorOffsets[cellOf[i]/bins + 1]++;
+		for(int sector = 0; sector < numSectors; sector++)
+			sectorOffsets[sector+1] += sectorOffsets[sector];
+		sectorPoints.resize(numPoints);
+		fill.assign(sectorOffsets.begin(), sectorOffsets.end()-1);
+		for(int i = 0; i < numPoints; i++)
+			sectorPoints[fill[cellOf[i]/bins]++] = i;
+
+		// Lowest point per cell
+		cellMinZ.assign(numSectors*bins, std::numeric_limits<float>::max());
+		parallelFor(numSectors, [&](int begin, int end)
+		{
+			for(int p = sectorOffsets[begin]; p < sectorOffsets[end]; p++)
+			{
+				int i = sectorPoints[p];
+				cellMinZ[cellOf[i]] = std::min(cellMinZ[cellOf[i]], points[i].z);
+			}
+		});
+
+		// Starting height of every sector walk, median of the lowest points in the near bins
+		nearMinZ.clear();
+		int nearBins = std::min(bins, std::max(1, (int)(10.0f / binSize)));
+		for(int sector = 0; sector < numSectors; sector++)
+			for(int bin = 0; bin < nearBins; bin++)
+				if(cellMinZ[sector*bins + bin] != std::numeric_limits<float>::max())
+					nearMinZ.push_back(cellMinZ[sector*bins + bin]);
+		float startGround = 0;
+		if(!nearMinZ.empty())
+		{
+			std::nth_element(nearMinZ.begin(), nearMinZ.begin() + nearMinZ.size()/2, nearMinZ.end());
+			startGround = nearMinZ[nearMinZ.size()/2];
+		}
+
+		// Walk every sector outwards and label its points
+		cellGround.resize(numSectors*bins);
+		isGround.resize(numPoints);
+		parallelFor(numSectors, [&](int begin, int end)
+		{
+			for(int sector = begin; sector < end; sector++)
+			{
+				float previousGround = startGround;
+				float previousRange = 0;
+				for(int bin = 0; bin < bins; bin++)
+				{
+					int cell = sector*bins + bin;
+					float range = (bin + 0.5f)*binSize;
+					float allowedStep = maxSlope*(range - previousRange) + heightThreshold;
+					if(cellMinZ[cell] != std::numeric_limits<float>::max() && fabsf(cellMinZ[cell] - previousGround) <= allowedStep)
+					{
+						previousGround = cellMinZ[cell];
+						previousRange = range;
+					}
+					cellGround[cell] = previousGround;
+				}
+
+				for(int p = sectorOffsets[sector]; p < sectorOffsets[sector+1]; p++)
+				{
+					int i = sectorPoints[p];
+					isGround[i] = points[i].z <= cellGround[cellOf[i]] + heightThreshold;
+				}
+			}
+		});
+
+		ground.clear();
+		for(int i = 0; i < numPoints; i++)
+			if(isGround[i])
+				ground.push_back(i);
+	}
+
+};
+
+#endif /* GROUND_GRID_H */
@@ -0,0 +1,77 @@
+// Per frame detection output of batch runs, as CSV or as a compact binary file.
+//
+// Binary layout, little endian: the 8 byte magic "SFNDBOX1", then per frame an int32 frame
+// index, an int32 box count and count records of 7 float32 (x, y, z, length, width, height, yaw).
+
+#ifndef BOX_WRITER_H
+#define BOX_WRITER_H
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "../render/box.h"
+
+class BoxWriter
+{
+public:
+
+	BoxWriter()
+	: file(NULL), csv(false)
+	{}
+
+	~BoxWriter()
+	{
+		close();
+	}
+
+	// CSV when path ends with .csv, binary otherwise
+	bool open(const std::string &path)
+	{
+		close();
+		csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+		file = fopen(path.c_str(), csv ? "w" : "wb");
+		if(!file)
+		{
+			std::cerr << "Couldn't write boxes to " << path << std::endl;
+			return false;
+		}
+		if(csv)
+			fputs("frame,box,x,y,z,length,width,height,yaw\n", file);
+		else
+			fwrite("SFNDBOX1", 1, 8, file);
+		return true;
+	}
+
+	void write(int frameIndex, const std::vector<BoxRecord> &boxes)
+	{
+		if(!file)
+			return;
+		if(csv)
+		{
+			for(int b = 0; b < (int)boxes.size(); b++)
+				fprintf(file, "%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f\n", frameIndex, b, boxes[b].x, boxes[b].y, boxes[b].z,
+				        boxes[b].length, boxes[b].width, boxes[b].height, boxes[b].yaw);
+			return;
+		}
+		int32_t header[2] = {frameIndex, (int32_t)boxes.size()};
+		fwrite(header, sizeof(header), 1, file);
+		if(!boxes.empty())
+			fwrite(&boxes[0], sizeof(BoxRecord), boxes.size(), file);
+	}
+
+	void close()
+	{
+		if(file)
+			fclose(file);
+		file = NULL;
+	}
+
+private:
+
+	FILE *file;
+	bool csv;
+};
+
+#endif /* BOX_WRITER_H */
@@ -0,0 +1,480 @@
+// Memory mapped reader for binary and binary_compressed pcd files
+
+#ifndef PCD_READER_H
+#define PCD_READER_H
+
+#include <pcl/point_cloud.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../utils/pointTraits.h"
+#include "../utils/soaCloud.h"
+
+// Read only mapping of a whole file, unmapped when it goes out of scope
+class MappedFile
+{
+public:
+
+	MappedFile()
+	: fileData(NULL), fileSize(0)
+	{}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const std::string &file)
+	{
+		close();
+		int fd = ::open(file.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+
+		struct stat info;
+		if(fstat(fd, &info) == 0 && info.st_size > 0)
+		{
+			void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(mapped != MAP_FAILED)
+			{
+				fileData = (const char*)mapped;
+				fileSize = info.st_size;
+				// pcd files and stream indexes are mostly read front to back
+				madvise(mapped, fileSize, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+		return fileData != NULL;
+	}
+
+	void close()
+	{
+		if(fileData != NULL)
+			munmap((void*)fileData, fileSize);
+		fileData = NULL;
+		fileSize = 0;
+	}
+
+	const char* data() const { return fileData; }
+	size_t size() const { return fileSize; }
+
+private:
+
+	// not copyable, the mapping has a single owner
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char *fileData;
+	size_t fileSize;
+};
+
+
+struct PcdHeader
+{
+	std::vector<std::string> fields;
+	std::vector<int> sizes;
+	std::vector<char> types;
+	std::vector<int> counts;
+	int width, height, points;
+	// ascii, binary or binary_compressed
+	std::string data;
+	// byte offset of the point data in the file
+	size_t dataOffset;
+
+	PcdHeader()
+	: width(0), height(0), points(0), dataOffset(0)
+	{}
+
+	void clear()
+	{
+		fields.clear();
+		sizes.clear();
+		types.clear();
+		counts.clear();
+		width = height = points = 0;
+		data.clear();
+		dataOffset = 0;
+	}
+
+	int field(const std::string &name) const
+	{
+		for(size_t f = 0; f < fields.size(); f++)
+			if(fields[f] == name)
+				return f;
+		return -1;
+	}
+
+	// byte offset of field f inside one binary point record
+	int fieldOffset(int f) const
+	{
+		int offset = 0;
+		for(int i = 0; i < f; i++)
+			offset += sizes[i]*counts[i];
+		return offset;
+	}
+
+	int pointSize() const
+	{
+		return fieldOffset(fields.size());
+	}
+};
+
+
+// Next whitespace separated token of [position, end), false once the line is used up
+inline bool nextPcdToken(const char *&position, const char *end, const char *&token, size_t &length)
+{
+	while(position < end && isspace((unsigned char)*position))
+		position++;
+	if(position == end)
+		return false;
+	token = position;
+	while(position < end && !isspace((unsigned char)*position))
+		position++;
+	length = position - token;
+	return true;
+}
+
+inline bool pcdTokenIs(const char *token, size_t length, const char *key)
+{
+	return length == strlen(key) && memcmp(token, key, length) == 0;
+}
+
+// Integer value of a token, the mapped file is not null terminated so the digits are copied out first
+inline int pcdTokenInt(const char *token, size_t length)
+{
+	char digits[32];
+	length = std::min(length, sizeof(digits) - 1);
+	memcpy(digits, token, length);
+	digits[length] = 0;
+	return atoi(digits);
+}
+
+// Parse the text header at the start of a pcd file, everything up to and including the DATA line.
+// Tokens are read in place, a header reused across files keeps its buffers.
+inline bool parsePcdHeader(const char *begin, size_t length, PcdHeader &header)
+{
+	header.clear();
+	size_t position = 0;
+	while(position < length)
+	{
+		const char *lineEnd = (const char*)memchr(begin + position, '\n', length - position);
+		size_t lineLength = lineEnd ? lineEnd - (begin + position) : length - position;
+		const char *cursor = begin + position, *end = begin + position + lineLength;
+		position += lineLength + 1;
+
+		const char *key, *token;
+		size_t keyLength, tokenLength;
+		if(!nextPcdToken(cursor, end, key, keyLength) || key[0] == '#')
+			continue;
+
+		if(pcdTokenIs(key, keyLength, "FIELDS"))
+		{
+			while(nextPcdToken(cursor, end, token, tokenLength))
+				header.fields.push_back(std::string(token, tokenLength));
+		}
+		else if(pcdTokenIs(key, keyLength, "SIZE"))
+		{
+			while(nextPcdToken(cursor, end, token, tokenLength))
+				header.sizes.push_back(pcdTokenInt(token, tokenLength));
+		}
+		else if(pcdTokenIs(key, keyLength, "TYPE"))
+		{
+			while(nextPcdToken(cursor, end, token, tokenLength))
+				header.types.push_back(token[0]);
+		}
+		else if(pcdTokenIs(key, keyLength, "COUNT"))
+		{
+			while(nextPcdToken(cursor, end, token, tokenLength))
+				header.counts.push_back(pcdTokenInt(token, tokenLength));
+		}
+		else if(pcdTokenIs(key, keyLength, "WIDTH") && nextPcdToken(cursor, end, token, tokenLength))
+			header.width = pcdTokenInt(token, tokenLength);
+		else if(pcdTokenIs(key, keyLength, "HEIGHT") && nextPcdToken(cursor, end, token, tokenLength))
+			header.height = pcdTokenInt(token, tokenLength);
+		else if(pcdTokenIs(key, keyLength, "POINTS") && nextPcdToken(cursor, end, token, tokenLength))
+			header.points = pcdTokenInt(token, tokenLength);
+		else if(pcdTokenIs(key, keyLength, "DATA"))
+		{
+			if(nextPcdToken(cursor, end, token, tokenLength))
+				header.data.assign(token, tokenLength);
+			// a DATA line without newline at the end of a truncated file ends the header at the end of the file
+			header.dataOffset = std::min(position, length);
+			// COUNT is optional and defaults to 1
+			header.counts.resize(header.fields.size(), 1);
+			return header.sizes.size() == header.fields.size() && header.types.size() == header.fields.size();
+		}
+	}
+	return false;
+}
+
+
+// LZF decompression as used by binary_compressed pcd files, returns the number of bytes written or 0 on corrupt input
+inline size_t lzfDecompress(const unsigned char *input, size_t inputLength, unsigned char *output, size_t outputLength)
+{
+	const unsigned char *in = input, *inEnd = input + inputLength;
+	unsigned char *out = output, *outEnd = output + outputLength;
+
+	while(in < inEnd)
+	{
+		unsigned int control = *in++;
+		if(control < 32)
+		{
+			// literal run of control+1 bytes
+			control++;
+			if(out + control > outEnd || in + control > inEnd)
+				return 0;
+			memcpy(out, in, control);
+			out += control;
+			in += control;
+		}
+		else
+		{
+			// back reference
+			unsigned int length = control >> 5;
+			if(length == 7)
+			{
+				if(in >= inEnd)
+					return 0;
+				length += *in++;
+			}
+			if(in >= inEnd)
+				return 0;
+			const unsigned char *reference = out - ((control & 0x1f) << 8) - 1 - *in++;
+			length += 2;
+			if(out + length > outEnd || reference < output)
+				return 0;
+			// byte by byte, the reference may overlap the bytes being written
+			for(unsigned int i = 0; i < length; i++)
+				*out++ = *reference++;
+		}
+	}
+	return out - output;
+}
+
+
+// Reads binary and binary_compressed pcd files through a memory mapping. x, y, z and intensity
+// are taken from float fields; other fields are skipped. Returns false for ascii files or
+// unsupported layouts so the caller can fall back to pcl::io::loadPCDFile.
+//
+// With a region set, points outside it are rejected while decoding and never written to the
+// cloud, so a frame costs only the points a later crop would keep.
+template<typename PointT>
+class PcdReader
+{
+public:
+
+	PcdReader()
+	: cropping(false)
+	{}
+
+	// Keep only points inside [minPoint, maxPoint], like pcl::CropBox
+	void setRegion(const Eigen::Vector4f &minPoint, const Eigen::Vector4f &maxPoint)
+	{
+		cropping = true;
+		for(int axis = 0; axis < 3; axis++)
+		{
+			regionMin[axis] = minPoint[axis];
+			regionMax[axis] = maxPoint[axis];
+		}
+	}
+
+	void clearRegion()
+	{
+		cropping = false;
+	}
+
+	bool hasRegion() const
+	{
+		return cropping;
+	}
+
+	// Inside the region, or any point when none is set. NaN coordinates are outside.
+	bool inRegion(float x, float y, float z) const
+	{
+		return !cropping || (x >= regionMin[0] && x <= regionMax[0] && y >= regionMin[1] && y <= regionMax[1] &&
+		                     z >= regionMin[2] && z <= regionMax[2]);
+	}
+
+	bool read(const std::string &file, pcl::PointCloud<PointT> &cloud)
+	{
+		MappedFile mapped;
+		const char *fieldStart[4];
+		size_t fieldStride;
+		if(!locateFields(file, mapped, fieldStart, fieldStride))
+			return false;
+
+		int numPoints = header.points;
+		// with a region only the kept points are allocated, cloud keeps its capacity across frames
+		cloud.points.clear();
+		if(!cropping)
+			cloud.points.reserve(numPoints);
+		bool isDense = true;
+		for(int p = 0; p < numPoints; p++)
+		{
+			size_t offset = p*fieldStride;
+			PointT point;
+			memcpy(&point.x, fieldStart[0] + offset, 4);
+			memcpy(&point.y, fieldStart[1] + offset, 4);
+			memcpy(&point.z, fieldStart[2] + offset, 4);
+			if(!inRegion(point.x, point.y, point.z))
+				continue;
+
+			if(fieldStart[3] != NULL)
+			{
+				float intensity;
+				memcpy(&intensity, fieldStart[3] + offset, 4);
+				PointTraits<PointT>::setIntensity(point, intensity);
+			}
+			isDense &= std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z);
+			cloud.points.push_back(point);
+		}
+		int numKept = cloud.points.size();
+		cloud.width = header.width;
+		cloud.height = header.height;
+		if((size_t)cloud.width*cloud.height != (size_t)numKept)
+		{
+			cloud.width = numKept;
+			cloud.height = 1;
+		}
+		cloud.is_dense = isDense;
+		return true;
+	}
+
+	// Same file straight into SoA columns, a binary_compressed file already stores each field
+	// contiguously so every column is one copy
+	bool read(const std::string &file, SoaCloud<PointT> &cloud)
+	{
+		MappedFile mapped;
+		const char *fieldStart[4];
+		size_t fieldStride;
+		if(!locateFields(file, mapped, fieldStart, fieldStride))
+			return false;
+
+		int numPoints = header.points;
+		cloud.resize(numPoints);
+		if(numPoints == 0)
+			return true;
+		if(cropping)
+		{
+			readRegion(fieldStart, fieldStride, numPoints, cloud);
+			return true;
+		}
+		float *columns[4] = {&cloud.x[0], &cloud.y[0], &cloud.z[0], cloud.hasIntensity() ? &cloud.intensity[0] : NULL};
+		for(int i = 0; i < 4; i++)
+		{
+			if(columns[i] == NULL)
+				continue;
+			if(fieldStart[i] == NULL)
+				std::fill(columns[i], columns[i] + numPoints, 0.0f);
+			else if(fieldStride == 4)
+				memcpy(columns[i], fieldStart[i], 4*(size_t)numPoints);
+			else
+				for(int p = 0; p < numPoints; p++)
+					memcpy(columns[i] + p, fieldStart[i] + p*fieldStride, 4);
+		}
+		return true;
+	}
+
+private:
+
+	// Points inside the region appended column by column, cloud was sized for all of them
+	void readRegion(const char **fieldStart, size_t fieldStride, int numPoints, SoaCloud<PointT> &cloud) const
+	{
+		int numKept = 0;
+		for(int p = 0; p < numPoints; p++)
+		{
+			size_t offset = p*fieldStride;
+			float xyz[3];
+			memcpy(&xyz[0], fieldStart[0] + offset, 4);
+			memcpy(&xyz[1], fieldStart[1] + offset, 4);
+			memcpy(&xyz[2], fieldStart[2] + offset, 4);
+			if(!inRegion(xyz[0], xyz[1], xyz[2]))
+				continue;
+			cloud.x[numKept] = xyz[0];
+			cloud.y[numKept] = xyz[1];
+			cloud.z[numKept] = xyz[2];
+			if(cloud.hasIntensity())
+			{
+				float intensity = 0;
+				if(fieldStart[3] != NULL)
+					memcpy(&intensity, fieldStart[3] + offset, 4);
+				cloud.intensity[numKept] = intensity;
+			}
+			numKept++;
+		}
+		cloud.resize(numKept);
+	}
+
+	// Maps file and parses its header, fieldStart[i] is where the values of x, y, z and intensity
+	// start (NULL for a missing intensity) and fieldStride the distance between two values of a field
+	bool locateFields(const std::string &file, MappedFile &mapped, const char **fieldStart, size_t &fieldStride)
+	{
+		if(!mapped.open(file))
+			return false;
+
+		if(!parsePcdHeader(mapped.data(), mapped.size(), header))
+			return false;
+
+		int fieldIds[4] = {header.field("x"), header.field("y"), header.field("z"), header.field("intensity")};
+		for(int i = 0; i < 4; i++)
+			if(fieldIds[i] >= 0 && (header.types[fieldIds[i]] != 'F' || header.sizes[fieldIds[i]] != 4 || header.counts[fieldIds[i]] != 1))
+				fieldIds[i] = -1;
+		if(fieldIds[0] < 0 || fieldIds[1] < 0 || fieldIds[2] < 0)
+			return false;
+
+		int numPoints = header.points;
+		if(numPoints < 0 || header.dataOffset > mapped.size())
+			return false;
+		const char *data = mapped.data() + header.dataOffset;
+		size_t available = mapped.size() - header.dataOffset;
+
+		if(header.data == "binary")
+		{
+			fieldStride = header.pointSize();
+			if(available < fieldStride*numPoints)
+				return false;
+			for(int i = 0; i < 4; i++)
+				fieldStart[i] = fieldIds[i] < 0 ? NULL : data + header.fieldOffset(fieldIds[i]);
+		}
+		else if(header.data == "binary_compressed")
+		{
+			// compressed and uncompressed size, then lzf data holding every field contiguously
+			uint32_t sizes[2];
+			if(available < sizeof(sizes))
+				return false;
+			memcpy(sizes, data, sizeof(sizes));
+			if(available - sizeof(sizes) < sizes[0] || sizes[1] < (size_t)header.pointSize()*numPoints)
+				return false;
+			decompressed.resize(sizes[1]);
+			if(sizes[1] > 0 && lzfDecompress((const unsigned char*)data + sizeof(sizes), sizes[0], &decompressed[0], sizes[1]) != sizes[1])
+				return false;
+
+			fieldStride = 4;
+			for(int i = 0; i < 4; i++)
+				fieldStart[i] = fieldIds[i] < 0 ? NULL : (const char*)&decompressed[0] + header.fieldOffset(fieldIds[i])*numPoints;
+		}
+		else
+			return false;
+		return true;
+	}
+
+	// header and decompression buffer, reused across files
+	PcdHeader header;
+	std::vector<unsigned char> decompressed;
+	// region of setRegion, as plain arrays like VoxelCropFilter's
+	bool cropping;
+	float regionMin[3], regionMax[3];
+};
+
+#endif /* PCD_READER_H */
@@ -0,0 +1,189 @@
+// Pre-converted pcd stream: every frame of a directory stored once as raw PointT records
+// in a single file, so replay maps it and copies whole frames without any parsing
+
+#ifndef PCD_STREAM_INDEX_H
+#define PCD_STREAM_INDEX_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/io/pcd_io.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "pcdReader.h"
+
+// frame data starts on cache line boundaries
+#define PCD_INDEX_ALIGNMENT 64
+
+struct PcdIndexHeader
+{
+	char magic[8];
+	uint32_t pointSize;
+	uint32_t numFrames;
+};
+
+struct PcdIndexEntry
+{
+	uint64_t offset;
+	uint32_t numPoints;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+	// source pcd file when the index was built, a replaced frame no longer matches
+	uint64_t fileSize;
+	int64_t fileTime;
+};
+
+template<typename PointT>
+class PcdStreamIndex
+{
+public:
+
+	PcdStreamIndex()
+	: entries(NULL), numFrames(0)
+	{}
+
+	// Convert every file of stream into indexFile, binary files are read through PcdReader
+	static bool build(const std::vector<boost::filesystem::path> &stream, const std::string &indexFile)
+	{
+		std::ofstream out(indexFile.c_str(), std::ios::binary | std::ios::trunc);
+		if(!out)
+			return false;
+
+		PcdIndexHeader header;
+		memcpy(header.magic, "PCDIDX2", 8);
+		header.pointSize = sizeof(PointT);
+		header.numFrames = stream.size();
+		std::vector<PcdIndexEntry> entries(stream.size());
+
+		// header and table are written again once the offsets are known
+		uint64_t offset = alignUp(sizeof(header) + entries.size()*sizeof(PcdIndexEntry));
+		out.write((const char*)&header, sizeof(header));
+		if(!entries.empty())
+			out.write((const char*)&entries[0], entries.size()*sizeof(PcdIndexEntry));
+
+		PcdReader<PointT> reader;
+		pcl::PointCloud<PointT> cloud;
+		for(size_t frame = 0; frame < stream.size(); frame++)
+		{
+			if(!reader.read(stream[frame].string(), cloud) && pcl::io::loadPCDFile<PointT>(stream[frame].string(), cloud) == -1)
+			{
+				std::cerr << "Couldn't convert " << stream[frame].string() << " into " << indexFile << std::endl;
+				return false;
+			}
+
+			entries[frame].offset = offset;
+			entries[frame].numPoints = cloud.points.size();
+			entries[frame].width = cloud.width;
+			entries[frame].height = cloud.height;
+			entries[frame].reserved = 0;
+			if(!sourceStamp(stream[frame], entries[frame].fileSize, entries[frame].fileTime))
+				return false;
+
+			out.seekp(offset);
+			if(!cloud.points.empty())
+				out.write((const char*)&cloud.points[0], cloud.points.size()*sizeof(PointT));
+			offset = alignUp(offset + cloud.points.size()*sizeof(PointT));
+		}
+
+		out.seekp(0);
+		out.write((const char*)&header, sizeof(header));
+		if(!entries.empty())
+			out.write((const char*)&entries[0], entries.size()*sizeof(PcdIndexEntry));
+		return (bool)out;
+	}
+
+	bool open(const std::string &indexFile)
+	{
+		numFrames = 0;
+		if(!mapped.open(indexFile) || mapped.size() < sizeof(PcdIndexHeader))
+			return false;
+
+		const PcdIndexHeader *header = (const PcdIndexHeader*)mapped.data();
+		if(memcmp(header->magic, "PCDIDX2", 8) != 0 || header->pointSize != sizeof(PointT))
+			return false;
+		if(mapped.size() < sizeof(PcdIndexHeader) + header->numFrames*sizeof(PcdIndexEntry))
+			return false;
+
+		entries = (const PcdIndexEntry*)(mapped.data() + sizeof(PcdIndexHeader));
+		for(uint32_t frame = 0; frame < header->numFrames; frame++)
+			if(entries[frame].offset + (uint64_t)entries[frame].numPoints*sizeof(PointT) > mapped.size())
+				return false;
+		numFrames = header->numFrames;
+		return true;
+	}
+
+	// Built from exactly these files, same count and every file with the size and time recorded at build
+	bool matches(const std::vector<boost::filesystem::path> &stream) const
+	{
+		if(stream.size() != (size_t)numFrames)
+			return false;
+		for(int frame = 0; frame < numFrames; frame++)
+		{
+			uint64_t fileSize;
+			int64_t fileTime;
+			if(!sourceStamp(stream[frame], fileSize, fileTime) || fileSize != entries[frame].fileSize || fileTime != entries[frame].fileTime)
+				return false;
+		}
+		return true;
+	}
+
+	// Index file of a pcd directory, stored beside it as <directory>.pcdidx
+	static std::string indexPath(const std::string &dataPath)
+	{
+		boost::filesystem::path directory(dataPath);
+		if(directory.filename() == "." || directory.filename().empty())
+			directory = directory.parent_path();
+		return (directory.parent_path() / (directory.filename().string() + ".pcdidx")).string();
+	}
+
+	int size() const
+	{
+		return numFrames;
+	}
+
+	int numPoints(int frame) const
+	{
+		return entries[frame].numPoints;
+	}
+
+	// Points of a frame straight from the mapping, valid while the index is open
+	const PointT* points(int frame) const
+	{
+		return (const PointT*)(mapped.data() + entries[frame].offset);
+	}
+
+	// Copy one frame into cloud with a single bulk copy
+	void load(int frame, pcl::PointCloud<PointT> &cloud) const
+	{
+		const PointT *begin = points(frame);
+		cloud.points.assign(begin, begin + numPoints(frame));
+		cloud.width = entries[frame].width;
+		cloud.height = entries[frame].height;
+	}
+
+private:
+
+	static bool sourceStamp(const boost::filesystem::path &file, uint64_t &fileSize, int64_t &fileTime)
+	{
+		boost::system::error_code error;
+		fileSize = boost::filesystem::file_size(file, error);
+		if(error)
+			return false;
+		fileTime = boost::filesystem::last_write_time(file, error);
+		return !error;
+	}
+
+	static uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + PCD_INDEX_ALIGNMENT - 1) / PCD_INDEX_ALIGNMENT * PCD_INDEX_ALIGNMENT;
+	}
+
+	MappedFile mapped;
+	const PcdIndexEntry *entries;
+	int numFrames;
+};
+
+#endif /* PCD_STREAM_INDEX_H */
@@ -0,0 +1,105 @@
+// Blocking FIFO with a fixed capacity, connects the stages of the frame pipeline.
+// Items live in a ring of capacity slots allocated up front, so pushing and popping never allocate.
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+template<typename T>
+class BoundedQueue
+{
+public:
+
+	BoundedQueue(size_t setCapacity)
+	: capacity(std::max<size_t>(setCapacity, 1)), items(capacity), head(0), count(0), closed(false)
+	{}
+
+	// Blocks while the queue is full, returns false once the queue is closed
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this]{ return count < capacity || closed; });
+		if(closed)
+			return false;
+		items[(head + count++) % capacity] = std::move(item);
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Same without blocking, false when the queue is full or closed and item is left untouched
+	bool tryPush(T &item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(count == capacity || closed)
+			return false;
+		items[(head + count++) % capacity] = std::move(item);
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Blocks while the queue is empty, returns false when it is closed and drained
+	bool pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this]{ return count > 0 || closed; });
+		if(count == 0)
+			return false;
+		takeFront(item);
+		return true;
+	}
+
+	// Same without blocking, false when the queue is empty
+	bool tryPop(T &item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(count == 0)
+			return false;
+		takeFront(item);
+		return true;
+	}
+
+	// No more pushes, consumers still drain what is queued
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+
+	// Close and drop whatever is still queued
+	void abort()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		for(; count > 0; count--, head = (head + 1) % capacity)
+			items[head] = T();
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+
+private:
+
+	void takeFront(T &item)
+	{
+		item = std::move(items[head]);
+		head = (head + 1) % capacity;
+		count--;
+		notFull.notify_one();
+	}
+
+	size_t capacity;
+	std::vector<T> items;
+	size_t head;
+	size_t count;
+	bool closed;
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+};
+
+#endif /* BOUNDED_QUEUE_H */
@@ -0,0 +1,78 @@
+// Frame parallel batch processing for offline runs: frames are independent, so whole frames
+// are spread over a work stealing pool while the results still come back in stream order.
+
+#ifndef FRAME_BATCH_H
+#define FRAME_BATCH_H
+
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "framePipeline.h"
+#include "../utils/threadPool.h"
+
+template<typename PointT>
+class FrameBatch
+{
+public:
+
+	// chain:   processes one frame on pool worker worker, frame.index and frame.file are set
+	// consume: receives the finished frames in stream order on the thread that called run()
+	typedef std::function<void(int worker, Frame<PointT>&)> Chain;
+	typedef std::function<void(Frame<PointT>&)> Consumer;
+
+	// window: frames in flight at once, bounds memory when the consumer is slower than the pool
+	FrameBatch(ThreadPool &setPool, int setWindow = 0)
+	: pool(setPool), window(setWindow > 0 ? setWindow : 2*setPool.size())
+	{}
+
+	void run(const std::vector<boost::filesystem::path> &stream, Chain chain, Consumer consume)
+	{
+		// frame i lives in slot i % window until it is consumed
+		std::vector<Frame<PointT>> slots(window);
+		std::vector<bool> ready(window, false);
+		std::mutex readyMutex;
+		std::condition_variable frameReady;
+
+		auto submit = [&](int index)
+		{
+			pool.submit([&, index](int worker)
+			{
+				Frame<PointT> &frame = slots[index % window];
+				frame.index = index;
+				frame.file = stream[index].string();
+				chain(worker, frame);
+				std::lock_guard<std::mutex> lock(readyMutex);
+				ready[index % window] = true;
+				frameReady.notify_one();
+			});
+		};
+
+		int numFrames = stream.size();
+		for(int index = 0; index < std::min(window, numFrames); index++)
+			submit(index);
+
+		for(int index = 0; index < numFrames; index++)
+		{
+			int slot = index % window;
+			{
+				std::unique_lock<std::mutex> lock(readyMutex);
+				frameReady.wait(lock, [&]{ return ready[slot]; });
+				ready[slot] = false;
+			}
+			consume(slots[slot]);
+			// release the clouds before the slot takes the next frame, its buffers stay for reuse
+			slots[slot].recycle();
+			if(index + window < numFrames)
+				submit(index + window);
+		}
+	}
+
+private:
+
+	ThreadPool &pool;
+	int window;
+};
+
+#endif /* FRAME_BATCH_H */
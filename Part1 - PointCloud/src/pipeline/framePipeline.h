@@ -0,0 +1,271 @@
+// Staged frame pipeline for pcd playback: every stage runs on its own thread and
+// hands frames to the next one through a bounded queue, so loading, processing and
+// rendering overlap and throughput approaches the slowest stage instead of the sum.
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <pcl/point_cloud.h>
+#include <boost/filesystem.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "boundedQueue.h"
+#include "../render/box.h"
+#include "../cluster/clusterSet.h"
+#include "../utils/soaCloud.h"
+#include "../range/rangeImage.h"
+#include "../utils/profiler.h"
+#include "../utils/allocationCounter.h"
+#include "../tracking/tracker.h"
+
+// Everything the stages produce for one pcd file
+template<typename PointT>
+struct Frame
+{
+	int index;
+	std::string file;
+	typename pcl::PointCloud<PointT>::Ptr input;
+	typename pcl::PointCloud<PointT>::Ptr filtered;
+	std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segmented;
+	// organized view of input, only filled by the range image path
+	RangeImage image;
+	ClusterSet<PointT> clusters;
+	std::vector<Box> boxes;
+	BoxQVector boxesQ;
+	// boxes and boxesQ as tracker input, and the confirmed tracks after this frame, only filled when tracking is on
+	std::vector<BoxRecord> detections;
+	std::vector<TrackState> tracks;
+	// structure of arrays versions of input, filtered, segmented and clusters, the stages use these
+	// instead when the frame is processed as SoA
+	struct Soa
+	{
+		SoaCloud<PointT> input, filtered, obstacles, plane;
+		// DenoiseCloud output, swapped with filtered
+		SoaCloud<PointT> denoised;
+		SoaClusterSet<PointT> clusters;
+	} soa;
+	// time spent in every stage, same order as the stages were added
+	std::vector<double> stageMs;
+	std::chrono::steady_clock::time_point queuedAt;
+
+	Frame()
+	: index(-1)
+	{}
+
+	// Ready for the next file: the clouds go back to their pools, the buffers keep their capacity
+	void recycle()
+	{
+		index = -1;
+		input.reset();
+		filtered.reset();
+		segmented.first.reset();
+		segmented.second.reset();
+		clusters.clear();
+		boxes.clear();
+		boxesQ.clear();
+		detections.clear();
+		tracks.clear();
+		soa.input.clear();
+		soa.filtered.clear();
+		soa.obstacles.clear();
+		soa.plane.clear();
+		soa.denoised.clear();
+		soa.clusters.clear();
+		stageMs.clear();
+	}
+};
+
+template<typename PointT>
+class FramePipeline
+{
+public:
+
+	typedef std::function<void(Frame<PointT>&)> Stage;
+
+	// queueSize: frames buffered between two stages, bounds prefetching and memory
+	FramePipeline(size_t setQueueSize = 4)
+	: queueSize(setQueueSize), running(false), framesOut(0), latencyMs(0)
+	{}
+
+	~FramePipeline()
+	{
+		stop();
+	}
+
+	// Stages run in the order they are added, the first one usually loads the pcd file
+	void addStage(const std::string &name, Stage stage)
+	{
+		StageStats stats;
+		stats.name = name;
+		stats.totalMs = 0;
+		stats.maxMs = 0;
+		stats.count = 0;
+		stats.allocations = 0;
+		stats.profile = &Profiler::instance().stat("stage " + name);
+		stats.allocationProfile = &Profiler::instance().stat("stage " + name + " allocations", "allocs");
+		stages.push_back(stage);
+		stageStats.push_back(stats);
+	}
+
+	// Feeds the files of stream through the stages, replaying from the start when loop is set
+	void start(const std::vector<boost::filesystem::path> &stream, bool loop)
+	{
+		stop();
+		for(size_t q = 0; q <= stages.size(); q++)
+			queues.push_back(std::unique_ptr<BoundedQueue<Frame<PointT>>>(new BoundedQueue<Frame<PointT>>(queueSize)));
+		// enough room for every frame that can be in flight, including the one the caller holds
+		recycled.reset(new BoundedQueue<Frame<PointT>>((stages.size() + 1)*(queueSize + 1) + 1));
+
+		running = true;
+		startTime = std::chrono::steady_clock::now();
+		threads.push_back(std::thread(&FramePipeline::source, this, stream, loop));
+		for(size_t s = 0; s < stages.size(); s++)
+			threads.push_back(std::thread(&FramePipeline::runStage, this, s));
+	}
+
+	// Next finished frame in stream order, blocks until one is ready. False once the stream ended or stop() was called.
+	// The frame passed in is handed back to the source, so pass the same object on every call.
+	bool next(Frame<PointT> &frame)
+	{
+		if(queues.empty())
+			return false;
+		if(frame.index >= 0 && recycled)
+		{
+			frame.recycle();
+			recycled->tryPush(frame);
+		}
+		if(!queues.back()->pop(frame))
+			return false;
+
+		std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - frame.queuedAt;
+		// end to end latency is what the frame budget is about
+		Profiler::instance().frameDone(frame.index, std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		framesOut++;
+		latencyMs += std::chrono::duration<double, std::milli>(latency).count();
+		return true;
+	}
+
+	void stop()
+	{
+		if(!running)
+			return;
+		running = false;
+		for(auto &queue : queues)
+			queue->abort();
+		for(std::thread &thread : threads)
+			thread.join();
+		threads.clear();
+		queues.clear();
+		recycled.reset();
+	}
+
+	// Mean and worst latency of every stage, end to end latency and throughput so far
+	void printStats()
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "pipeline: " << framesOut << " frames, " << (wallMs > 0 ? 1000.0*framesOut/wallMs : 0) << " frames/s, "
+		          << (framesOut ? latencyMs/framesOut : 0) << " ms mean end to end latency" << std::endl;
+		for(const StageStats &stats : stageStats)
+		{
+			std::cout << "  " << std::setw(10) << stats.name << "  mean " << (stats.count ? stats.totalMs/stats.count : 0)
+			          << " ms, max " << stats.maxMs << " ms over " << stats.count << " frames";
+			if(allocationCounting())
+				std::cout << ", " << (stats.count ? (double)stats.allocations/stats.count : 0) << " allocations/frame";
+			std::cout << std::endl;
+		}
+		std::cout.unsetf(std::ios_base::floatfield);
+	}
+
+private:
+
+	struct StageStats
+	{
+		std::string name;
+		double totalMs;
+		double maxMs;
+		long count;
+		long allocations;
+		// same durations and allocation counts in the shared histograms
+		ProfileStat *profile;
+		ProfileStat *allocationProfile;
+	};
+
+	void source(std::vector<boost::filesystem::path> stream, bool loop)
+	{
+		int index = 0;
+		do
+		{
+			for(const boost::filesystem::path &file : stream)
+			{
+				// frames the caller is done with come back with their buffers
+				Frame<PointT> frame;
+				recycled->tryPop(frame);
+				frame.index = index++;
+				frame.file = file.native();
+				frame.queuedAt = std::chrono::steady_clock::now();
+				if(!queues[0]->push(std::move(frame)))
+					return;
+			}
+		}
+		while(loop && running && !stream.empty());
+		queues[0]->close();
+	}
+
+	// One thread per stage keeps frames in order without any reordering buffer
+	void runStage(size_t s)
+	{
+		Frame<PointT> frame;
+		while(queues[s]->pop(frame))
+		{
+			auto stageStart = std::chrono::steady_clock::now();
+			long allocationsBefore = threadAllocations().allocations;
+			stages[s](frame);
+			long allocations = threadAllocations().allocations - allocationsBefore;
+			double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stageStart).count();
+			frame.stageMs.push_back(elapsedMs);
+			if(Profiler::instance().enabled())
+			{
+				stageStats[s].profile->record(elapsedMs*1000);
+				if(allocationCounting())
+					stageStats[s].allocationProfile->record(allocations);
+			}
+			{
+				std::lock_guard<std::mutex> lock(statsMutex);
+				stageStats[s].totalMs += elapsedMs;
+				stageStats[s].maxMs = std::max(stageStats[s].maxMs, elapsedMs);
+				stageStats[s].count++;
+				stageStats[s].allocations += allocations;
+			}
+			if(!queues[s+1]->push(std::move(frame)))
+				return;
+		}
+		queues[s+1]->close();
+	}
+
+	size_t queueSize;
+	std::vector<Stage> stages;
+	std::vector<StageStats> stageStats;
+	std::vector<std::unique_ptr<BoundedQueue<Frame<PointT>>>> queues;
+	// finished frames handed back by next(), reused by the source
+	std::unique_ptr<BoundedQueue<Frame<PointT>>> recycled;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running;
+	std::mutex statsMutex;
+	std::chrono::steady_clock::time_point startTime;
+	long framesOut;
+	double latencyMs;
+};
+
+#endif /* FRAME_PIPELINE_H */
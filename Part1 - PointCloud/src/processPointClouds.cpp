@@ -5,7 +5,8 @@
 
 //constructor:
 template<typename PointT>
-ProcessPointClouds<PointT>::ProcessPointClouds() {}
+ProcessPointClouds<PointT>::ProcessPointClouds()
+: regionInliers(new pcl::PointIndices), segmentInliers(new pcl::PointIndices) {}
 
 
 //de-constructor:
@@ -25,10 +26,11 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(ty
 {
 
     // Time segmentation process
+    PROFILE_SCOPE("FilterCloud");
     auto startTime = std::chrono::steady_clock::now();
 
     // TODO:: Fill in the function to do voxel grid point reduction and region based filtering
-    typename pcl::PointCloud<PointT>::Ptr filterCloud (new pcl::PointCloud<PointT>());
+    typename pcl::PointCloud<PointT>::Ptr filterCloud = cloudPool.acquire(cloud->points.size());
     // Filtering our point cloud using voxel grid filter
     pcl::VoxelGrid<PointT> sor;
     sor.setInputCloud (cloud);
@@ -36,52 +38,141 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(ty
     sor.filter (*filterCloud);
 
     // Downsampling cloud with only points that were inside the region specified
-    typename pcl::PointCloud<PointT>::Ptr regionCloud (new pcl::PointCloud<PointT>());
-    std::vector<int> indicesToRemoved;
+    typename pcl::PointCloud<PointT>::Ptr regionCloud = cloudPool.acquire(filterCloud->points.size());
 
     pcl::CropBox<PointT> region(true); // Extract_removed_indices Set to true to extract indicies to be removed
     region.setInputCloud(filterCloud);
     region.setMin(minPoint);
     region.setMax(maxPoint);
-    region.filter(indicesToRemoved);
+    region.filter(regionIndices);
 
-    // Removing filterd points from output pointcloud
-    pcl::PointIndices::Ptr inliers {new pcl::PointIndices};
-    for(int index : indicesToRemoved)
-        inliers->indices.push_back(index);
+    // Keeping only the points inside the region, CropBox returned their indices
+    regionInliers->indices.assign(regionIndices.begin(), regionIndices.end());
 
     pcl::ExtractIndices<PointT> extract;
     extract.setInputCloud(filterCloud);
-    extract.setIndices(inliers);
-    extract.setNegative(true);
+    extract.setIndices(regionInliers);
+    extract.setNegative(false);
     extract.filter(*regionCloud);
 
     auto endTime = std::chrono::steady_clock::now();
     auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "filtering took " << elapsedTime.count() << " milliseconds" << std::endl;
+    if(verbose)
+        std::cout << "filtering took " << elapsedTime.count() << " milliseconds" << std::endl;
+    PROFILE_COUNT("FilterCloud points", regionCloud->points.size());
 
     return regionCloud;
 
 }
 
 
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloudFused(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint,
+                                                                                   Eigen::Vector4f roofMin, Eigen::Vector4f roofMax)
+{
+
+    // Time filtering process
+    PROFILE_SCOPE("FilterCloudFused");
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Points outside the region or on the roof are rejected before voxelization,
+    // the survivors are averaged per voxel through a hash of voxel keys in the same pass
+    typename pcl::PointCloud<PointT>::Ptr regionCloud = cloudPool.acquire();
+    voxelCropFilter.leafSize = filterRes;
+    voxelCropFilter.setRegion(minPoint, maxPoint);
+    voxelCropFilter.setRoof(roofMin, roofMax);
+    voxelCropFilter.filter(*cloud, *regionCloud);
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "fused filtering took " << elapsedTime.count() << " milliseconds" << std::endl;
+
+    return regionCloud;
+
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::DenoiseCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float minIntensity, float minRange, float maxRange,
+                                                                               int meanK, float stddevMul, float searchRadius)
+{
+    // The gate and the outlier statistics run on columns, the cloud is copied in and back out
+    noiseInput.fromCloud(*cloud);
+    DenoiseCloud(noiseInput, minIntensity, minRange, maxRange, meanK, stddevMul, searchRadius, noiseOutput);
+
+    typename pcl::PointCloud<PointT>::Ptr denoised = cloudPool.acquire(noiseOutput.size());
+    noiseOutput.toCloud(*denoised);
+    return denoised;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::DenoiseCloud(const SoaCloud<PointT>& cloud, float minIntensity, float minRange, float maxRange, int meanK, float stddevMul, float searchRadius,
+                                              SoaCloud<PointT>& denoised)
+{
+
+    // Time denoising process
+    PROFILE_SCOPE("DenoiseCloud");
+    auto startTime = std::chrono::steady_clock::now();
+
+    noiseFilter.minIntensity = minIntensity;
+    noiseFilter.minRange = minRange;
+    noiseFilter.maxRange = maxRange;
+    noiseFilter.meanK = meanK;
+    noiseFilter.stddevMul = stddevMul;
+    noiseFilter.searchRadius = searchRadius;
+    noiseFilter.filter(cloud, denoised);
+
+    denoiseTotals.frames++;
+    denoiseTotals.input += cloud.size();
+    denoiseTotals.gated += noiseFilter.gated;
+    denoiseTotals.outliers += noiseFilter.outliers;
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "denoising took " << elapsedTime.count() << " milliseconds, " << noiseFilter.gated << " points gated and "
+                  << noiseFilter.outliers << " outliers of " << cloud.size() << " removed" << std::endl;
+    PROFILE_COUNT("DenoiseCloud gated", noiseFilter.gated);
+    PROFILE_COUNT("DenoiseCloud outliers", noiseFilter.outliers);
+
+}
+
+
 template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud) 
 {
     // TODO: Create two new point clouds, one cloud with obstacles and other with segmented plane
 
-    typename pcl::PointCloud<PointT>::Ptr obstacles (new pcl::PointCloud<PointT>());
-    typename pcl::PointCloud<PointT>::Ptr road (new pcl::PointCloud<PointT>());
+    size_t numInliers = std::min(cloud->points.size(), inliers->indices.size());
+    typename pcl::PointCloud<PointT>::Ptr obstacles = cloudPool.acquire(cloud->points.size() - numInliers);
+    typename pcl::PointCloud<PointT>::Ptr road = cloudPool.acquire(numInliers);
 
-    std::cerr << "Model inliers: " << inliers->indices.size () << std::endl;
+    if(verbose)
+        std::cerr << "Model inliers: " << inliers->indices.size () << std::endl;
+    std::vector<bool>& isInlier = inlierMask;
+    isInlier.assign(cloud->points.size(), false);
     for (int index: inliers->indices)
-        road->points.push_back(cloud->points[index]);
-        
-    pcl::ExtractIndices<PointT> extract;
-    extract.setInputCloud(cloud);
-    extract.setIndices(inliers);
-    extract.setNegative(true); // Inverse picking, leaving the inliers & picking any other point
-    extract.filter(*obstacles);
+        isInlier[index] = true;
+
+    // One pass in cloud order, inliers go to the road and every other point to the obstacles
+    road->points.reserve(numInliers);
+    obstacles->points.reserve(cloud->points.size() - numInliers);
+    for (size_t index = 0; index < cloud->points.size(); index++)
+    {
+        if (isInlier[index])
+            road->points.push_back(cloud->points[index]);
+        else
+            obstacles->points.push_back(cloud->points[index]);
+    }
+
+    road->width = road->points.size();
+    road->height = 1;
+    road->is_dense = cloud->is_dense;
+    obstacles->width = obstacles->points.size();
+    obstacles->height = 1;
+    obstacles->is_dense = cloud->is_dense;
 
     std::pair<typename pcl::PointCloud<PointT>::Ptr,typename pcl::PointCloud<PointT>::Ptr> segResult(obstacles, road);
     return segResult;
@@ -89,34 +180,73 @@ std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT
 
 
 template<typename PointT>
-std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold)
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold, PlaneBackend backend)
 {
     // Time segmentation process
+    PROFILE_SCOPE("SegmentPlane");
     auto startTime = std::chrono::steady_clock::now();
     // TODO:: Fill in this function to find inliers for the cloud.
-    pcl::SACSegmentation<PointT> seg;
-    // Defining the type of a plane using model coefficients for rendering
-    pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
-    pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
-
-    // To get the best out of model by optimization 
-    seg.setOptimizeCoefficients (true);
-    seg.setModelType (pcl::SACMODEL_PLANE); 
-    seg.setMethodType (pcl::SAC_RANSAC); // Random sample consensus algorithm
-    seg.setDistanceThreshold(distanceThreshold);
-    seg.setMaxIterations(maxIterations);
-    
-    seg.setInputCloud(cloud);
-    seg.segment(*inliers, *coefficients);
-
-    if (inliers->indices.size () == 0)
+    pcl::PointIndices::Ptr inliers = segmentInliers;
+    inliers->indices.clear();
+
+    if(backend == PclRansac)
+    {
+        pcl::SACSegmentation<PointT> seg;
+        // Defining the type of a plane using model coefficients for rendering
+        pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
+
+        // To get the best out of model by optimization 
+        seg.setOptimizeCoefficients (true);
+        seg.setModelType (pcl::SACMODEL_PLANE); 
+        seg.setMethodType (pcl::SAC_RANSAC); // Random sample consensus algorithm
+        seg.setDistanceThreshold(distanceThreshold);
+        seg.setMaxIterations(maxIterations);
+        
+        seg.setInputCloud(cloud);
+        seg.segment(*inliers, *coefficients);
+    }
+    else
+    {
+        // Hypotheses spread over all cores, stops early once the confidence bound is met
+        ransacPlane.setInputCloud(cloud->points);
+        ransacPlane.segment(maxIterations, distanceThreshold, inliers->indices);
+    }
+
+    if (inliers->indices.size () == 0 && verbose)
     {
         std::cout<< "Could not estimate a planar model for the given dataset." << std::endl;
     }
 
     auto endTime = std::chrono::steady_clock::now();
     auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "plane segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
+    if(verbose)
+        std::cout << "plane segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
+    PROFILE_COUNT("SegmentPlane inliers", inliers->indices.size());
+
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateClouds(inliers,cloud);
+    return segResult;
+}
+
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentGround(typename pcl::PointCloud<PointT>::Ptr cloud, float binSize, float heightThreshold, float maxSlope)
+{
+    // Time segmentation process
+    PROFILE_SCOPE("SegmentGround");
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Local ground heights on a polar grid, handles sloped streets where one plane does not fit
+    groundGrid.binSize = binSize;
+    groundGrid.heightThreshold = heightThreshold;
+    groundGrid.maxSlope = maxSlope;
+
+    pcl::PointIndices::Ptr inliers = segmentInliers;
+    groundGrid.segment(cloud->points, inliers->indices);
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "ground segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
 
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateClouds(inliers,cloud);
     return segResult;
@@ -124,51 +254,184 @@ std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT
 
 
 template<typename PointT>
-std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize)
+void ProcessPointClouds<PointT>::Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterSet<PointT>& clusters, ClusterBackend backend)
 {
 
     // Time clustering process
+    PROFILE_SCOPE("Clustering");
     auto startTime = std::chrono::steady_clock::now();
 
-    std::vector<typename pcl::PointCloud<PointT>::Ptr> clusters;
+    clusters.clear();
 
     // TODO:: Fill in the function to perform euclidean clustering to group detected obstacles
-    typename pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-    tree->setInputCloud(cloud);
+    if(backend == PclKdTree)
+    {
+        std::vector<pcl::PointIndices> clusterIndices;
+        typename pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
+        tree->setInputCloud(cloud);
+
+        pcl::EuclideanClusterExtraction<PointT> ec;
+
+        ec.setClusterTolerance (clusterTolerance);
+        ec.setMinClusterSize (minSize);
+        ec.setMaxClusterSize (maxSize);
+        ec.setSearchMethod (tree);
+        ec.setInputCloud(cloud);
+        ec.extract(clusterIndices);    
+
+        int clusteredPoints = 0;
+        for(const pcl::PointIndices& getIndices : clusterIndices)
+            clusteredPoints += getIndices.indices.size();
+        clusters.points.reserve(clusteredPoints);
+        clusters.offsets.reserve(clusterIndices.size() + 1);
+        for(const pcl::PointIndices& getIndices : clusterIndices)
+            clusters.add(cloud->points, getIndices.indices.data(), getIndices.indices.size());
+    }
+    else
+    {
+        const typename pcl::PointCloud<PointT>::VectorType& points = cloud->points;
+        extractClusters([&points](int id){ return points[id].data; }, points.size(), clusterTolerance, minSize, maxSize, backend);
+
+        const EuclideanCluster& result = euclideanCluster;
+        clusters.points.reserve(result.indices.size());
+        clusters.offsets.reserve(clusterOrder.size() + 1);
+        for(int cluster : clusterOrder)
+            clusters.add(points, result.indices.data() + result.offsets[cluster], result.clusterSize(cluster));
+    }
 
-    std::vector<pcl::PointIndices> clusterIndices;
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "clustering took " << elapsedTime.count() << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
+    PROFILE_COUNT("Clustering clusters", clusters.size());
+    PROFILE_COUNT("Clustering points", clusters.points.size());
+}
 
-    pcl::EuclideanClusterExtraction<PointT> ec;
 
-    ec.setClusterTolerance (clusterTolerance);
-    ec.setMinClusterSize (minSize);
-    ec.setMaxClusterSize (maxSize);
-    ec.setSearchMethod (tree);
-    ec.setInputCloud(cloud);
-    ec.extract(clusterIndices);    
+template<typename PointT>
+std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterBackend backend)
+{
+    ClusterSet<PointT> clusters;
+    Clustering(cloud, clusterTolerance, minSize, maxSize, clusters, backend);
+    return clusters.toClouds();
+}
 
-    for(pcl::PointIndices getIndices : clusterIndices){
-        
-        typename pcl::PointCloud<PointT>::Ptr cloudCluster (new pcl::PointCloud<PointT>);
 
-        for(int index: getIndices.indices){
-            cloudCluster->points.push_back(cloud->points[index]);
-        }
-
-        cloudCluster->width = cloudCluster->points.size();
-        cloudCluster->height = 1;
-        cloudCluster->is_dense = true;
+template<typename PointT>
+template<typename GetPoint>
+void ProcessPointClouds<PointT>::extractClusters(GetPoint getPoint, int numPoints, float clusterTolerance, int minSize, int maxSize, ClusterBackend backend)
+{
+    if(backend == CustomKdTree || (backend == ReusedKdTree && measureIndexSavings))
+    {
+        auto buildStart = std::chrono::steady_clock::now();
+        kdTree.reserve(numPoints);
+        for(int index = 0; index < numPoints; index++)
+            kdTree.insert(getPoint(index), index);
+        kdTree.build();
+        if(backend == ReusedKdTree)
+            incrementalTree.stats.fullBuildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+    }
 
-        clusters.push_back(cloudCluster);
+    if(backend == CustomKdTree)
+        euclideanCluster.extract(kdTree, getPoint, numPoints, clusterTolerance, minSize, maxSize);
+    else if(backend == VoxelHash)
+    {
+        voxelIndex.build(getPoint, numPoints, clusterTolerance);
+        euclideanCluster.extract(voxelIndex, getPoint, numPoints, clusterTolerance, minSize, maxSize);
+    }
+    else
+    {
+        // Only the delta to the previous frame is applied, points that stayed within the quantum are kept
+        auto updateStart = std::chrono::steady_clock::now();
+        incrementalTree.update(getPoint, numPoints);
+        incrementalTree.stats.updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStart).count();
+        euclideanCluster.extract(incrementalTree, getPoint, numPoints, clusterTolerance, minSize, maxSize);
     }
+    kdTree.reset();
+
+    // Same ordering as pcl::EuclideanClusterExtraction, biggest cluster first, ties in discovery
+    // order as a stable sort would keep them without its temporary buffer
+    const EuclideanCluster& result = euclideanCluster;
+    std::vector<int>& order = clusterOrder;
+    order.resize(result.numClusters());
+    for(size_t cluster = 0; cluster < order.size(); cluster++)
+        order[cluster] = cluster;
+    std::sort(order.begin(), order.end(), [&result](int a, int b){ return result.clusterSize(a) > result.clusterSize(b) || (result.clusterSize(a) == result.clusterSize(b) && a < b); });
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::ProjectRangeImage(typename pcl::PointCloud<PointT>::Ptr cloud, RangeImage& image)
+{
+
+    // Time projection process
+    PROFILE_SCOPE("ProjectRangeImage");
+    auto startTime = std::chrono::steady_clock::now();
+
+    image.project(cloud->points);
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "range image projection took " << elapsedTime.count() << " milliseconds, " << image.numPoints() << " of " << cloud->points.size() << " points kept" << std::endl;
+}
+
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentGroundImage(typename pcl::PointCloud<PointT>::Ptr cloud, RangeImage& image, float sensorHeight, float heightThreshold, float maxSlope)
+{
+    // Time segmentation process
+    PROFILE_SCOPE("SegmentGroundImage");
+    auto startTime = std::chrono::steady_clock::now();
+
+    rangeSegmentation.removeGround(image, cloud->points, sensorHeight, heightThreshold, maxSlope);
 
-    
+    // Points that lost their cell to a closer return keep no label and count as obstacles
+    pcl::PointIndices::Ptr inliers = segmentInliers;
+    inliers->indices.clear();
+    for(size_t cell = 0; cell < image.ground.size(); cell++)
+        if(image.ground[cell])
+            inliers->indices.push_back(image.index[cell]);
+    std::sort(inliers->indices.begin(), inliers->indices.end());
 
     auto endTime = std::chrono::steady_clock::now();
     auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "clustering took " << elapsedTime.count() << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
+    if(verbose)
+        std::cout << "range image ground segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
+
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateClouds(inliers,cloud);
+    return segResult;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::ClusteringImage(typename pcl::PointCloud<PointT>::Ptr cloud, const RangeImage& image, float clusterTolerance, int minSize, int maxSize, ClusterSet<PointT>& clusters, float sizeVoxel)
+{
+
+    // Time clustering process
+    PROFILE_SCOPE("ClusteringImage");
+    auto startTime = std::chrono::steady_clock::now();
+
+    clusters.clear();
+    const RangeSegmentation& result = rangeSegmentation;
+    rangeSegmentation.cluster(image, cloud->points, clusterTolerance, minSize, maxSize, sizeVoxel);
+
+    // Same ordering as Clustering, biggest cluster first
+    std::vector<int>& order = clusterOrder;
+    order.resize(result.numClusters());
+    for(size_t cluster = 0; cluster < order.size(); cluster++)
+        order[cluster] = cluster;
+    std::sort(order.begin(), order.end(), [&result](int a, int b){ return result.clusterSize(a) > result.clusterSize(b) || (result.clusterSize(a) == result.clusterSize(b) && a < b); });
+
+    clusters.points.reserve(result.indices.size());
+    clusters.offsets.reserve(order.size() + 1);
+    for(int cluster : order)
+        clusters.add(cloud->points, result.indices.data() + result.offsets[cluster], result.clusterSize(cluster));
 
-    return clusters;
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "range image clustering took " << elapsedTime.count() << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
 }
 
 
@@ -193,29 +456,380 @@ Box ProcessPointClouds<PointT>::BoundingBox(typename pcl::PointCloud<PointT>::Pt
 
 
 template<typename PointT>
-void ProcessPointClouds<PointT>::savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file)
+Box ProcessPointClouds<PointT>::BoundingBox(const ClusterSet<PointT>& clusters, int cluster)
+{
+
+    // Min and max straight over the cluster's range of the shared buffer
+    Box box;
+    box.x_min = box.y_min = box.z_min = std::numeric_limits<float>::max();
+    box.x_max = box.y_max = box.z_max = -std::numeric_limits<float>::max();
+    for(const PointT* point = clusters.begin(cluster); point != clusters.end(cluster); point++)
+    {
+        box.x_min = std::min(box.x_min, point->x);
+        box.y_min = std::min(box.y_min, point->y);
+        box.z_min = std::min(box.z_min, point->z);
+        box.x_max = std::max(box.x_max, point->x);
+        box.y_max = std::max(box.y_max, point->y);
+        box.z_max = std::max(box.z_max, point->z);
+    }
+
+    return box;
+}
+
+
+// Oriented box fit in the xy plane to the BoxQ used by renderBox
+inline BoxQ toBoxQ(const OrientedBox& orientedBox)
+{
+    BoxQ box;
+    box.bboxTransform = Eigen::Vector3f(orientedBox.x, orientedBox.y, orientedBox.z);
+    box.bboxQuaternion = Eigen::Quaternionf(Eigen::AngleAxisf(orientedBox.yaw, Eigen::Vector3f::UnitZ()));
+    box.cube_length = orientedBox.length;
+    box.cube_width = orientedBox.width;
+    box.cube_height = orientedBox.height;
+    return box;
+}
+
+
+template<typename PointT>
+BoxQ ProcessPointClouds<PointT>::BoundingBoxQ(typename pcl::PointCloud<PointT>::Ptr cluster)
+{
+    const PointT* points = cluster->points.data();
+    return toBoxQ(orientedBoxFit.fit(points, points + cluster->points.size()));
+}
+
+
+template<typename PointT>
+BoxQ ProcessPointClouds<PointT>::BoundingBoxQ(const ClusterSet<PointT>& clusters, int cluster)
 {
-    pcl::io::savePCDFileASCII (file, *cloud);
-    std::cerr << "Saved " << cloud->points.size () << " data points to "+file << std::endl;
+    return toBoxQ(orientedBoxFit.fit(clusters.begin(cluster), clusters.end(cluster)));
 }
 
 
 template<typename PointT>
-typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::loadPcd(std::string file)
+BoxQVector ProcessPointClouds<PointT>::BoundingBoxQ(const ClusterSet<PointT>& clusters)
 {
+    BoxQVector boxes;
+    BoundingBoxQ(clusters, boxes);
+    return boxes;
+}
+
 
-    typename pcl::PointCloud<PointT>::Ptr cloud (new pcl::PointCloud<PointT>);
+template<typename PointT>
+void ProcessPointClouds<PointT>::BoundingBoxQ(const ClusterSet<PointT>& clusters, BoxQVector& boxes)
+{
+
+    // Time box fitting process
+    PROFILE_SCOPE("BoundingBoxQ");
+    auto startTime = std::chrono::steady_clock::now();
+
+    orientedBoxFit.fit(clusters, orientedBoxes);
+    boxes.clear();
+    boxes.reserve(orientedBoxes.size());
+    for(const OrientedBox& orientedBox : orientedBoxes)
+        boxes.push_back(toBoxQ(orientedBox));
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "oriented boxes took " << elapsedTime.count() << " microseconds for " << boxes.size() << " clusters" << std::endl;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::FilterCloud(const SoaCloud<PointT>& cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint, SoaCloud<PointT>& filtered,
+                                             Eigen::Vector4f roofMin, Eigen::Vector4f roofMax)
+{
+
+    // Time filtering process
+    PROFILE_SCOPE("FilterCloud");
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Crop and roof removal first, then the voxel hash of FilterCloudFused
+    voxelCropFilter.leafSize = filterRes;
+    voxelCropFilter.setRegion(minPoint, maxPoint);
+    voxelCropFilter.setRoof(roofMin, roofMax);
+    voxelCropFilter.filter(cloud, filtered);
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "SoA filtering took " << elapsedTime.count() << " milliseconds" << std::endl;
+    PROFILE_COUNT("FilterCloud points", filtered.size());
+
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::SegmentPlane(const SoaCloud<PointT>& cloud, int maxIterations, float distanceThreshold, SoaCloud<PointT>& obstacles, SoaCloud<PointT>& plane)
+{
+    // Time segmentation process
+    PROFILE_SCOPE("SegmentPlane");
+    auto startTime = std::chrono::steady_clock::now();
+
+    // RANSAC reads the columns in place, the best plane comes back as a byte per point
+    // and each column is split by it on its own
+    int numPoints = cloud.size();
+    ransacPlane.setInputColumns(cloud.x.data(), cloud.y.data(), cloud.z.data(), numPoints);
+    planeMask.resize(numPoints);
+    int numInliers = numPoints > 0 ? ransacPlane.segment(maxIterations, distanceThreshold, planeMask.data()) : 0;
+
+    if (numInliers == 0 && verbose)
+    {
+        std::cout<< "Could not estimate a planar model for the given dataset." << std::endl;
+    }
+
+    obstacles.clear();
+    plane.clear();
+    if(numPoints > 0)
+    {
+        obstacles.select(cloud, planeMask.data(), 0);
+        plane.select(cloud, planeMask.data(), 1);
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "SoA plane segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
+    PROFILE_COUNT("SegmentPlane inliers", numInliers);
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::Clustering(const SoaCloud<PointT>& cloud, float clusterTolerance, int minSize, int maxSize, SoaClusterSet<PointT>& clusters, ClusterBackend backend)
+{
+
+    // Time clustering process
+    PROFILE_SCOPE("Clustering");
+    auto startTime = std::chrono::steady_clock::now();
+
+    clusters.clear();
+    int numPoints = cloud.size();
+
+    if(backend == PclKdTree)
+    {
+        // pcl only searches its own clouds
+        typename pcl::PointCloud<PointT>::Ptr pclCloud = cloudPool.acquire(numPoints);
+        cloud.toCloud(*pclCloud);
+
+        std::vector<pcl::PointIndices> clusterIndices;
+        typename pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
+        tree->setInputCloud(pclCloud);
+
+        pcl::EuclideanClusterExtraction<PointT> ec;
+        ec.setClusterTolerance (clusterTolerance);
+        ec.setMinClusterSize (minSize);
+        ec.setMaxClusterSize (maxSize);
+        ec.setSearchMethod (tree);
+        ec.setInputCloud(pclCloud);
+        ec.extract(clusterIndices);
+
+        for(const pcl::PointIndices& getIndices : clusterIndices)
+            clusters.add(cloud, getIndices.indices.data(), getIndices.indices.size());
+    }
+    else
+    {
+        // The indexes search over xyz triples, packed once per frame
+        packedPoints.resize(3*numPoints);
+        for(int i = 0; i < numPoints; i++)
+        {
+            packedPoints[3*i] = cloud.x[i];
+            packedPoints[3*i+1] = cloud.y[i];
+            packedPoints[3*i+2] = cloud.z[i];
+        }
+        const float* packed = packedPoints.data();
+        extractClusters([packed](int id){ return packed + 3*id; }, numPoints, clusterTolerance, minSize, maxSize, backend);
+
+        const EuclideanCluster& result = euclideanCluster;
+        clusters.points.reserve(result.indices.size());
+        clusters.offsets.reserve(clusterOrder.size() + 1);
+        for(int cluster : clusterOrder)
+            clusters.add(cloud, result.indices.data() + result.offsets[cluster], result.clusterSize(cluster));
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    if(verbose)
+        std::cout << "SoA clustering took " << elapsedTime.count() << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
+    PROFILE_COUNT("Clustering clusters", clusters.size());
+    PROFILE_COUNT("Clustering points", clusters.points.size());
+}
+
+
+template<typename PointT>
+Box ProcessPointClouds<PointT>::BoundingBox(const SoaCloud<PointT>& cluster)
+{
+    Box box;
+    box.x_min = box.y_min = box.z_min = std::numeric_limits<float>::max();
+    box.x_max = box.y_max = box.z_max = -std::numeric_limits<float>::max();
+    columnMinMax(cluster.x.data(), 0, cluster.size(), box.x_min, box.x_max);
+    columnMinMax(cluster.y.data(), 0, cluster.size(), box.y_min, box.y_max);
+    columnMinMax(cluster.z.data(), 0, cluster.size(), box.z_min, box.z_max);
+    return box;
+}
+
+
+template<typename PointT>
+Box ProcessPointClouds<PointT>::BoundingBox(const SoaClusterSet<PointT>& clusters, int cluster)
+{
+
+    // Each axis is a contiguous range of its column
+    int begin = clusters.offsets[cluster], end = clusters.offsets[cluster+1];
+    Box box;
+    box.x_min = box.y_min = box.z_min = std::numeric_limits<float>::max();
+    box.x_max = box.y_max = box.z_max = -std::numeric_limits<float>::max();
+    columnMinMax(clusters.points.x.data(), begin, end, box.x_min, box.x_max);
+    columnMinMax(clusters.points.y.data(), begin, end, box.y_min, box.y_max);
+    columnMinMax(clusters.points.z.data(), begin, end, box.z_min, box.z_max);
+
+    return box;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setVerbose(bool setVerbose)
+{
+    verbose = setVerbose;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setNumThreads(int numThreads)
+{
+    ransacPlane.numThreads = numThreads;
+    groundGrid.numThreads = numThreads;
+    orientedBoxFit.numThreads = numThreads;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setRandomSeed(uint64_t seed)
+{
+    ransacPlane.seed = seed;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setMeasureIndexSavings(bool measure)
+{
+    measureIndexSavings = measure;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::printIndexStats()
+{
+    const IncrementalKdTreeStats& stats = incrementalTree.stats;
+    long frames = std::max(stats.frames, 1L);
+    long points = std::max(stats.kept + stats.inserted, 1L);
+    std::cout << "reused kd-tree: " << stats.frames << " frames, " << 100.0*stats.kept/points << "% of points kept, "
+              << stats.rebuilds << " rebuilds, update " << stats.updateMs/frames << " ms/frame";
+    if(measureIndexSavings)
+        std::cout << ", full build " << stats.fullBuildMs/frames << " ms/frame, saved " << (stats.fullBuildMs - stats.updateMs)/frames << " ms/frame";
+    std::cout << std::endl;
+}
+
+
+template<typename PointT>
+const DenoiseStats& ProcessPointClouds<PointT>::denoiseStats() const
+{
+    return denoiseTotals;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::printDenoiseStats()
+{
+    const DenoiseStats& stats = denoiseTotals;
+    long frames = std::max(stats.frames, 1L);
+    long points = std::max(stats.input, 1L);
+    std::cout << "denoise: " << stats.frames << " frames, " << stats.gated/frames << " points gated and " << stats.outliers/frames
+              << " outliers removed per frame, " << 100.0*(stats.gated + stats.outliers)/points << "% fewer points for segmentation and clustering" << std::endl;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file, PcdFormat format)
+{
+    if(format == PcdBinary)
+        pcl::io::savePCDFileBinary (file, *cloud);
+    else if(format == PcdBinaryCompressed)
+        pcl::io::savePCDFileBinaryCompressed (file, *cloud);
+    else
+        pcl::io::savePCDFileASCII (file, *cloud);
+    if(verbose)
+        std::cerr << "Saved " << cloud->points.size () << " data points to " << file << std::endl;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setLoadRegion(Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint)
+{
+    pcdReader.setRegion(minPoint, maxPoint);
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::clearLoadRegion()
+{
+    pcdReader.clearRegion();
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::loadPcd(const std::string& file)
+{
+
+    typename pcl::PointCloud<PointT>::Ptr cloud = cloudPool.acquire();
 
     if (pcl::io::loadPCDFile<PointT> (file, *cloud) == -1) //* load the file
     {
         PCL_ERROR ("Couldn't read file \n");
     }
-    std::cerr << "Loaded " << cloud->points.size () << " data points from "+file << std::endl;
+    if (pcdReader.hasRegion())
+    {
+        // pcl reads the whole file, the load region is applied in place afterwards
+        int numKept = 0;
+        for (const PointT& point : cloud->points)
+            if (pcdReader.inRegion(point.x, point.y, point.z))
+                cloud->points[numKept++] = point;
+        cloud->points.resize(numKept);
+        cloud->width = numKept;
+        cloud->height = 1;
+    }
+    if(verbose)
+        std::cerr << "Loaded " << cloud->points.size () << " data points from " << file << std::endl;
+
+    return cloud;
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::loadPcdMapped(const std::string& file)
+{
+
+    typename pcl::PointCloud<PointT>::Ptr cloud = cloudPool.acquire();
+
+    // Binary files are read straight from the mapping, anything else goes through pcl
+    if (!pcdReader.read(file, *cloud))
+        return loadPcd(file);
+    if(verbose)
+        std::cerr << "Loaded " << cloud->points.size () << " data points from " << file << std::endl;
 
     return cloud;
 }
 
 
+template<typename PointT>
+void ProcessPointClouds<PointT>::loadPcdMapped(const std::string& file, SoaCloud<PointT>& cloud)
+{
+
+    if (!pcdReader.read(file, cloud))
+        cloud.fromCloud(*loadPcd(file));
+    if(verbose)
+        std::cerr << "Loaded " << cloud.size () << " data points from " << file << std::endl;
+}
+
+
 template<typename PointT>
 std::vector<boost::filesystem::path> ProcessPointClouds<PointT>::streamPcd(std::string dataPath)
 {
@@ -227,4 +841,11 @@ std::vector<boost::filesystem::path> ProcessPointClouds<PointT>::streamPcd(std::
 
     return paths;
 
-}
\ No newline at end of file
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::acquireCloud(size_t expectedSize)
+{
+    return cloudPool.acquire(expectedSize);
+}
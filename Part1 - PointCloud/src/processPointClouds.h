@@ -17,7 +17,52 @@
 #include <vector>
 #include <ctime>
 #include <chrono>
+#include <limits>
 #include "render/box.h"
+#include "utils/profiler.h"
+#include "utils/cloudPool.h"
+#include "utils/soaCloud.h"
+#include "cluster/kdtree.h"
+#include "cluster/incrementalKdTree.h"
+#include "cluster/voxelHashIndex.h"
+#include "cluster/euclideanCluster.h"
+#include "cluster/clusterSet.h"
+#include "bbox/orientedBox.h"
+#include "range/rangeImage.h"
+#include "range/rangeSegmentation.h"
+#include "ransac/ransacPlane.h"
+#include "ground/groundGrid.h"
+#include "filters/voxelCropFilter.h"
+#include "filters/noiseFilter.h"
+#include "io/pcdReader.h"
+#include "io/pcdStreamIndex.h"
+
+// Neighbour search used by Clustering
+enum ClusterBackend
+{
+    PclKdTree, CustomKdTree, ReusedKdTree, VoxelHash
+};
+
+// Encoding written by savePcd
+enum PcdFormat
+{
+    PcdAscii, PcdBinary, PcdBinaryCompressed
+};
+
+// Points DenoiseCloud removed over all frames so far, and where
+struct DenoiseStats
+{
+    long frames = 0;
+    long input = 0;
+    long gated = 0;
+    long outliers = 0;
+};
+
+// Plane fitting used by SegmentPlane
+enum PlaneBackend
+{
+    PclRansac, NativeRansac
+};
 
 template<typename PointT>
 class ProcessPointClouds {
@@ -32,19 +77,159 @@ public:
 
     typename pcl::PointCloud<PointT>::Ptr FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
 
+    // Same region crop and voxel downsampling as FilterCloud plus ego roof removal, fused in one pass
+    typename pcl::PointCloud<PointT>::Ptr FilterCloudFused(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint,
+                                                           Eigen::Vector4f roofMin = Eigen::Vector4f(-1.5, -1.7, -1, 1), Eigen::Vector4f roofMax = Eigen::Vector4f(2.6, 1.7, -0.4, 1));
+
+    // Drops returns weaker than minIntensity or outside [minRange, maxRange] from the sensor, then statistical
+    // outliers: points whose mean distance to their meanK nearest neighbours within searchRadius is above
+    // mean + stddevMul * stddev of the frame. Meant between FilterCloud and SegmentPlane, meanK 0 only gates.
+    typename pcl::PointCloud<PointT>::Ptr DenoiseCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float minIntensity, float minRange, float maxRange,
+                                                       int meanK, float stddevMul, float searchRadius);
+
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud);
 
-    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold);
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold, PlaneBackend backend = PclRansac);
+
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentGround(typename pcl::PointCloud<PointT>::Ptr cloud, float binSize, float heightThreshold, float maxSlope);
 
-    std::vector<typename pcl::PointCloud<PointT>::Ptr> Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize);
+    // Clusters as one point buffer plus a range per cluster, clusters keeps its capacity across frames
+    void Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterSet<PointT>& clusters, ClusterBackend backend = PclKdTree);
+
+    // Same clusters copied into a cloud each, kept for compatibility
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterBackend backend = PclKdTree);
+
+    // Organized range image path, image is filled by Lidar::scan(image) or ProjectRangeImage and indexes cloud
+    void ProjectRangeImage(typename pcl::PointCloud<PointT>::Ptr cloud, RangeImage& image);
+
+    // Ground by walking every image column up from the sensor foot, also marks the ground cells of image
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentGroundImage(typename pcl::PointCloud<PointT>::Ptr cloud, RangeImage& image, float sensorHeight, float heightThreshold, float maxSlope);
+
+    // Connected components of the non ground cells of image, same result type and ordering as Clustering.
+    // Only the closest return of every cell takes part: points that lost their cell to a closer one in
+    // ProjectRangeImage are in no cluster, so clusters can be smaller than those of Clustering on the same cloud.
+    // With sizeVoxel > 0 minSize and maxSize count the voxels of that size a cluster covers instead of its cells,
+    // the limits tuned for a cloud voxelized at sizeVoxel then apply to the raw returns of the image.
+    void ClusteringImage(typename pcl::PointCloud<PointT>::Ptr cloud, const RangeImage& image, float clusterTolerance, int minSize, int maxSize, ClusterSet<PointT>& clusters, float sizeVoxel = 0);
 
     Box BoundingBox(typename pcl::PointCloud<PointT>::Ptr cluster);
 
-    void savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file);
+    Box BoundingBox(const ClusterSet<PointT>& clusters, int cluster);
+
+    // Yaw only oriented box, minimum footprint over the candidate yaws of OrientedBoxFit
+    BoxQ BoundingBoxQ(typename pcl::PointCloud<PointT>::Ptr cluster);
+
+    BoxQ BoundingBoxQ(const ClusterSet<PointT>& clusters, int cluster);
+
+    // Oriented boxes of every cluster of a frame, fitted in parallel across clusters
+    BoxQVector BoundingBoxQ(const ClusterSet<PointT>& clusters);
+
+    // Same boxes written into boxes, which keeps its capacity across frames
+    void BoundingBoxQ(const ClusterSet<PointT>& clusters, BoxQVector& boxes);
+
+    // Structure of arrays path, a frame read with loadPcdMapped(file, cloud) stays in SoaCloud columns
+    // up to its boxes. Every output is replaced and keeps its capacity across frames.
+
+    // Region crop, ego roof removal and voxel downsampling of FilterCloudFused, cropped first by a vectorized mask pass
+    void FilterCloud(const SoaCloud<PointT>& cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint, SoaCloud<PointT>& filtered,
+                     Eigen::Vector4f roofMin = Eigen::Vector4f(-1.5, -1.7, -1, 1), Eigen::Vector4f roofMax = Eigen::Vector4f(2.6, 1.7, -0.4, 1));
 
-    typename pcl::PointCloud<PointT>::Ptr loadPcd(std::string file);
+    void DenoiseCloud(const SoaCloud<PointT>& cloud, float minIntensity, float minRange, float maxRange, int meanK, float stddevMul, float searchRadius,
+                      SoaCloud<PointT>& denoised);
+
+    // NativeRansac over the columns in place, inliers go to plane and every other point to obstacles
+    void SegmentPlane(const SoaCloud<PointT>& cloud, int maxIterations, float distanceThreshold, SoaCloud<PointT>& obstacles, SoaCloud<PointT>& plane);
+
+    void Clustering(const SoaCloud<PointT>& cloud, float clusterTolerance, int minSize, int maxSize, SoaClusterSet<PointT>& clusters, ClusterBackend backend = CustomKdTree);
+
+    Box BoundingBox(const SoaCloud<PointT>& cluster);
+
+    Box BoundingBox(const SoaClusterSet<PointT>& clusters, int cluster);
+
+    // false silences the per call timing and load messages, for batch runs
+    void setVerbose(bool setVerbose);
+
+    // Threads used inside one call by RANSAC, the ground grid and the oriented boxes,
+    // 1 when whole frames are processed in parallel
+    void setNumThreads(int numThreads);
+
+    // Seed of the NativeRansac samples, the same seed and cloud give the same plane on any number of threads
+    void setRandomSeed(uint64_t seed);
+
+    // ReusedKdTree instrumentation, measure also times a from scratch KdTree build of every frame for comparison
+    void setMeasureIndexSavings(bool measure);
+
+    void printIndexStats();
+
+    const DenoiseStats& denoiseStats() const;
+
+    void printDenoiseStats();
+
+    void savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file, PcdFormat format = PcdAscii);
+
+    // Loads keep only the points inside [minPoint, maxPoint]. loadPcdMapped rejects the others while decoding,
+    // loadPcd once pcl has read the file. Give FilterCloud's region grown by one voxel, PCL's FilterCloud
+    // voxelizes before it crops and the voxels on the region border need all their points.
+    void setLoadRegion(Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
+
+    void clearLoadRegion();
+
+    typename pcl::PointCloud<PointT>::Ptr loadPcd(const std::string& file);
+
+    // Memory mapped read of binary and binary_compressed files, falls back to loadPcd for ascii
+    typename pcl::PointCloud<PointT>::Ptr loadPcdMapped(const std::string& file);
+
+    // Binary files straight into SoA columns, ascii files are loaded by pcl and converted
+    void loadPcdMapped(const std::string& file, SoaCloud<PointT>& cloud);
 
     std::vector<boost::filesystem::path> streamPcd(std::string dataPath);
+
+    // Empty cloud from the pool the clouds returned above come from, back in the pool once released
+    typename pcl::PointCloud<PointT>::Ptr acquireCloud(size_t expectedSize = 0);
+
+private:
+
+    // CustomKdTree, ReusedKdTree or VoxelHash clustering of the points getPoint returns,
+    // leaves the clusters in euclideanCluster and their order, biggest first, in clusterOrder
+    template<typename GetPoint>
+    void extractClusters(GetPoint getPoint, int numPoints, float clusterTolerance, int minSize, int maxSize, ClusterBackend backend);
+
+    // Scratch state of the CustomKdTree backend, kept so its buffers are reused across frames
+    KdTree<3> kdTree;
+    EuclideanCluster euclideanCluster;
+    // Index of the ReusedKdTree backend, follows the frames instead of being rebuilt
+    IncrementalKdTree<3> incrementalTree;
+    // Index of the VoxelHash backend, cells as big as the cluster tolerance
+    VoxelHashIndex<PointT> voxelIndex;
+    bool measureIndexSavings = false;
+    bool verbose = true;
+    // SoA buffers of the NativeRansac backend
+    RansacPlane ransacPlane;
+    // Polar grid buffers of SegmentGround
+    GroundGrid groundGrid;
+    // Labels and queue of ClusteringImage
+    RangeSegmentation rangeSegmentation;
+    // Yaw tables and per frame results of BoundingBoxQ
+    OrientedBoxFit orientedBoxFit;
+    std::vector<OrientedBox> orientedBoxes;
+    // Voxel hash table of FilterCloudFused
+    VoxelCropFilter<PointT> voxelCropFilter;
+    // Gate and outlier index of DenoiseCloud, the columns the pcl version runs on and its totals
+    NoiseFilter<PointT> noiseFilter;
+    SoaCloud<PointT> noiseInput, noiseOutput;
+    DenoiseStats denoiseTotals;
+    // Decompression buffer of loadPcdMapped
+    PcdReader<PointT> pcdReader;
+    // Clouds and index buffers of every frame, reused once the previous frames released them
+    CloudPool<PointT> cloudPool;
+    std::vector<int> regionIndices;
+    pcl::PointIndices::Ptr regionInliers;
+    pcl::PointIndices::Ptr segmentInliers;
+    std::vector<bool> inlierMask;
+    std::vector<int> clusterOrder;
+    // Inlier mask of the SoA SegmentPlane and packed xyz the SoA Clustering searches over
+    std::vector<uint8_t> planeMask;
+    std::vector<float> packedPoints;
   
 };
 #endif /* PROCESSPOINTCLOUDS_H_ */
\ No newline at end of file
@@ -6,6 +6,11 @@
 #include <chrono>
 #include <string>
 #include "kdtree.h"
+#include "../../cluster/voxelHashIndex.h"
+
+// 1 clusters with a VoxelHashIndex instead of the kd tree, anything with
+// std::vector<int> search(std::vector<float> target, float distanceTol) works as tree
+#define USE_VOXEL_HASH 0
 
 // Arguments:
 // window is the region to draw box around
@@ -73,25 +78,32 @@ void render2DTree(Node* node, pcl::visualization::PCLVisualizer::Ptr& viewer, Bo
 
 }
 
-void proximity(std::vector<std::vector<float>> points, KdTree* tree, std::vector<int> &cluster, \
+// Grows the cluster of pntIndex breadth first with an explicit queue, cluster doubles as the queue:
+// points are appended once when first reached and expanded in order, so no stack frame per point
+template<typename Tree>
+void proximity(const std::vector<std::vector<float>>& points, Tree* tree, std::vector<int> &cluster, \
 			   std::vector<bool> &isProcessed, int &pntIndex, float &distanceTol)
 {
 	isProcessed[pntIndex] = true;
 	cluster.push_back(pntIndex);
 
-	std::vector<int> nearbyPntIds = tree->search(points[pntIndex], distanceTol);
+	for(int next = 0; next < cluster.size(); next++){
 
-	for(int id : nearbyPntIds){
+		std::vector<int> nearbyPntIds = tree->search(points[cluster[next]], distanceTol);
 
-		if(isProcessed[pntIndex])
-			continue;
-		
-		proximity(points, tree ,cluster, isProcessed, id, distanceTol);
+		for(int id : nearbyPntIds){
 
+			if(isProcessed[id])
+				continue;
+
+			isProcessed[id] = true;
+			cluster.push_back(id);
+		}
 	}
 }
 
-std::vector<std::vector<int>> euclideanCluster(const std::vector<std::vector<float>>& points, KdTree* tree, float distanceTol)
+template<typename Tree>
+std::vector<std::vector<int>> euclideanCluster(const std::vector<std::vector<float>>& points, Tree* tree, float distanceTol)
 {
 
 	// TODO: Fill out this function to return list of indices for each cluster
@@ -148,7 +160,15 @@ int main ()
   	// Time segmentation process
   	auto startTime = std::chrono::steady_clock::now();
   	//
-  	std::vector<std::vector<int>> clusters = euclideanCluster(points, tree, 3.0);
+  	std::vector<std::vector<int>> clusters;
+  	if(USE_VOXEL_HASH)
+  	{
+  		VoxelHashIndex<pcl::PointXYZ> voxelIndex;
+  		voxelIndex.build(cloud->points, 3.0);
+  		clusters = euclideanCluster(points, &voxelIndex, 3.0);
+  	}
+  	else
+  		clusters = euclideanCluster(points, tree, 3.0);
   	//
   	auto endTime = std::chrono::steady_clock::now();
   	auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
@@ -6,17 +6,20 @@
 #include "../../processPointClouds.h"
 // using templates for processPointClouds so also include .cpp to help linker
 #include "../../processPointClouds.cpp"
+#include "../../utils/random.h"
 #include <math.h>
 
 pcl::PointCloud<pcl::PointXYZ>::Ptr CreateData()
 {
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>());
+  	// Fixed seed so every run scatters the points the same way
+  	RandomStream random(1);
   	// Add inliers
   	float scatter = 0.6;
   	for(int i = -5; i < 5; i++)
   	{
-  		double rx = 2*(((double) rand() / (RAND_MAX))-0.5);
-  		double ry = 2*(((double) rand() / (RAND_MAX))-0.5);
+  		double rx = random.uniform(-1, 1);
+  		double ry = random.uniform(-1, 1);
   		pcl::PointXYZ point;
   		point.x = i+scatter*rx;
   		point.y = i+scatter*ry;
@@ -28,8 +31,8 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr CreateData()
   	int numOutliers = 10;
   	while(numOutliers--)
   	{
-  		double rx = 2*(((double) rand() / (RAND_MAX))-0.5);
-  		double ry = 2*(((double) rand() / (RAND_MAX))-0.5);
+  		double rx = random.uniform(-1, 1);
+  		double ry = random.uniform(-1, 1);
   		pcl::PointXYZ point;
   		point.x = 5*rx;
   		point.y = 5*ry;
@@ -62,10 +65,11 @@ pcl::visualization::PCLVisualizer::Ptr initScene()
   	return viewer;
 }
 
-std::unordered_set<int> Ransac(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol)
+// seed picks the random samples, the same seed gives the same line
+std::unordered_set<int> Ransac(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol, uint64_t seed = 0)
 {
 	std::unordered_set<int> inliersResult;
-	srand(time(NULL));
+	RandomStream random(seed);
 	
 	// TODO: Fill in this function
 
@@ -74,8 +78,8 @@ std::unordered_set<int> Ransac(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int ma
 		
 		std::unordered_set<int> inliers;
 
-		int randIndex_1 = rand() %  cloudSize;
-		int randIndex_2 = rand() % cloudSize;
+		int randIndex_1 = random.below(cloudSize);
+		int randIndex_2 = random.below(cloudSize);
 
 		pcl::PointXYZ point1 = cloud->points[randIndex_1];
 		pcl::PointXYZ point2 = cloud->points[randIndex_2];
@@ -106,11 +110,12 @@ std::unordered_set<int> Ransac(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int ma
 }
 
 
-std::unordered_set<int> RansacPlane(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol)
+// seed picks the random samples, the same seed gives the same plane
+std::unordered_set<int> RansacPlane(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol, uint64_t seed = 0)
 {
 
 	std::unordered_set<int> inliersResult;
-	srand(time(NULL));
+	RandomStream random(seed);
 
 	 // Time segmentation process
     auto startTime = std::chrono::steady_clock::now();
@@ -120,9 +125,9 @@ std::unordered_set<int> RansacPlane(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, i
 		
 		std::unordered_set<int> inliers;
 
-		int randIndex_1 = rand() %  cloudSize;
-		int randIndex_2 = rand() % cloudSize;
-		int randIndex_3 = rand() & cloudSize;
+		int randIndex_1 = random.below(cloudSize);
+		int randIndex_2 = random.below(cloudSize);
+		int randIndex_3 = random.below(cloudSize);
 
 		pcl::PointXYZ point1 = cloud->points[randIndex_1];
 		pcl::PointXYZ point2 = cloud->points[randIndex_2];
@@ -0,0 +1,116 @@
+// Organized view of a lidar frame: one cell per ring and azimuth step holding the closest return.
+// Neighbours in the image are neighbours in space, so segmentation can walk the grid instead of a tree.
+
+#ifndef RANGE_IMAGE_H
+#define RANGE_IMAGE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+struct RangeImage
+{
+	// rings sorted by elevation, lowest first
+	int rows;
+	int cols;
+	// elevation of every row in radians, ascending
+	std::vector<float> elevations;
+	// azimuth covered by one column, column 0 starts at azimuth 0
+	float azimuthStep;
+	// sensor position the ranges are measured from
+	float origin[3];
+
+	// point id in the source cloud per cell, -1 for an empty cell
+	std::vector<int> index;
+	// distance of that point from origin
+	std::vector<float> range;
+	// set by ground removal, 1 for ground cells
+	std::vector<unsigned char> ground;
+
+	RangeImage()
+	: rows(0), cols(0), azimuthStep(0)
+	{
+		origin[0] = origin[1] = origin[2] = 0;
+	}
+
+	// Layout of a sensor, elevations in degrees in any order and the azimuth step in degrees
+	void setRings(const std::vector<double> &elevationDegrees, double azimuthResolution)
+	{
+		elevations.clear();
+		for(double elevation : elevationDegrees)
+			elevations.push_back(elevation*M_PI/180);
+		std::sort(elevations.begin(), elevations.end());
+		rows = elevations.size();
+		cols = (int)ceil(360.0/azimuthResolution - 1e-6);
+		azimuthStep = 2*M_PI/cols;
+	}
+
+	// Empty all cells of the current layout
+	void clear()
+	{
+		index.assign(rows*cols, -1);
+		range.assign(rows*cols, 0);
+		ground.assign(rows*cols, 0);
+	}
+
+	int cell(int row, int col) const
+	{
+		return row*cols + col;
+	}
+
+	// Row whose elevation is closest to elevation in radians, -1 while no layout is set
+	int rowOf(float elevation) const
+	{
+		if(rows == 0)
+			return -1;
+		int row = std::lower_bound(elevations.begin(), elevations.end(), elevation) - elevations.begin();
+		if(row == rows)
+			return rows - 1;
+		if(row > 0 && elevation - elevations[row-1] < elevations[row] - elevation)
+			return row - 1;
+		return row;
+	}
+
+	// -1 while no layout is set
+	int colOf(float azimuth) const
+	{
+		if(cols == 0)
+			return -1;
+		if(azimuth < 0)
+			azimuth += 2*M_PI;
+		return std::min((int)(azimuth / azimuthStep), cols - 1);
+	}
+
+	// Keep point id in cell when it is the closest return seen there
+	void set(int cell, int id, float distance)
+	{
+		if(index[cell] < 0 || distance < range[cell])
+		{
+			index[cell] = id;
+			range[cell] = distance;
+		}
+	}
+
+	// Projection pass for unorganized clouds, points: any container of PCL-like points.
+	// Without a layout there is no cell to project to and the image stays empty.
+	template<typename Points>
+	void project(const Points &points)
+	{
+		clear();
+		if(rows == 0 || cols == 0)
+			return;
+		for(size_t id = 0; id < points.size(); id++)
+		{
+			float x = points[id].x - origin[0], y = points[id].y - origin[1], z = points[id].z - origin[2];
+			float planar = sqrtf(x*x + y*y);
+			set(cell(rowOf(atan2f(z, planar)), colOf(atan2f(y, x))), id, sqrtf(planar*planar + z*z));
+		}
+	}
+
+	int numPoints() const
+	{
+		return index.size() - std::count(index.begin(), index.end(), -1);
+	}
+};
+
+#endif /* RANGE_IMAGE_H */
@@ -0,0 +1,168 @@
+// Ground removal and euclidean clustering on a RangeImage. Both visit every cell a constant
+// number of times, so a frame costs O(n) and needs no spatial index.
+
+#ifndef RANGE_SEGMENTATION_H
+#define RANGE_SEGMENTATION_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "rangeImage.h"
+
+// Widest azimuth window searched around a cell, bounds the cost of returns right next to the sensor
+#define RANGE_MAX_COL_WINDOW 16
+
+struct RangeSegmentation
+{
+	// rings searched above and below a cell while clustering
+	int rowWindow;
+	// cluster id per cell, -1 until the cell is queued
+	std::vector<int> label;
+	// cells of the cluster that is growing
+	std::vector<int> queue;
+	// point ids of all kept clusters back to back, cluster c is indices[offsets[c], offsets[c+1])
+	std::vector<int> indices;
+	std::vector<int> offsets;
+	// voxels of the cluster that is growing, see clusterVoxels
+	std::vector<uint64_t> voxelKeys;
+
+	RangeSegmentation()
+	: rowWindow(1)
+	{}
+
+	int numClusters() const
+	{
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	int clusterSize(int cluster) const
+	{
+		return offsets[cluster+1] - offsets[cluster];
+	}
+
+	// Walks every column from the lowest ring up against a ground reference that starts at the sensor foot.
+	// A return is ground when it is within heightThreshold plus maxSlope times its planar distance from the
+	// reference. The reference only moves to returns that continue the slope on their own, so the rings
+	// climbing a wall step by step can't drag it up.
+	template<typename Points>
+	int removeGround(RangeImage &image, const Points &points, float sensorHeight, float heightThreshold, float maxSlope) const
+	{
+		int numGround = 0;
+		image.ground.assign(image.rows*image.cols, 0);
+		for(int col = 0; col < image.cols; col++)
+		{
+			float groundPlanar = 0, groundZ = image.origin[2] - sensorHeight;
+			for(int row = 0; row < image.rows; row++)
+			{
+				int cell = image.cell(row, col);
+				if(image.index[cell] < 0)
+					continue;
+
+				const float x = points[image.index[cell]].x - image.origin[0], y = points[image.index[cell]].y - image.origin[1];
+				float planar = sqrtf(x*x + y*y);
+				float z = points[image.index[cell]].z;
+				float rise = maxSlope*std::max(0.0f, planar - groundPlanar);
+				if(fabsf(z - groundZ) <= heightThreshold + rise)
+				{
+					image.ground[cell] = 1;
+					numGround++;
+					if(fabsf(z - groundZ) <= rise)
+					{
+						groundPlanar = planar;
+						groundZ = z;
+					}
+				}
+			}
+		}
+		return numGround;
+	}
+
+	// Connected components of the non ground cells, two cells connect when they are in each other's window
+	// and their points are within distanceTol. The azimuth window covers distanceTol at the cell's range.
+	// Clusters smaller than minSize or larger than maxSize are dropped, like pcl::EuclideanClusterExtraction.
+	// Size is the number of cells, or with sizeVoxel > 0 the number of voxels of that size the cluster
+	// covers: a near car fills far more cells than a far one, the limits of a voxelized cloud then still fit.
+	template<typename Points>
+	int cluster(const RangeImage &image, const Points &points, float distanceTol, int minSize, int maxSize, float sizeVoxel = 0)
+	{
+		int numCells = image.rows*image.cols;
+		label.assign(numCells, -1);
+		indices.clear();
+		offsets.assign(1, 0);
+		const float tolSquared = distanceTol*distanceTol;
+		const bool hasGround = image.ground.size() == (size_t)numCells;
+
+		for(int seed = 0; seed < numCells; seed++)
+		{
+			if(image.index[seed] < 0 || label[seed] >= 0 || (hasGround && image.ground[seed]))
+				continue;
+
+			int id = numClusters();
+			queue.clear();
+			queue.push_back(seed);
+			label[seed] = id;
+			for(size_t head = 0; head < queue.size(); head++)
+			{
+				int cell = queue[head];
+				int row = cell / image.cols, col = cell % image.cols;
+				const auto &point = points[image.index[cell]];
+				int colWindow = std::min(RANGE_MAX_COL_WINDOW, (int)ceilf(distanceTol / (std::max(image.range[cell], 1e-3f)*image.azimuthStep)));
+
+				for(int r = std::max(0, row - rowWindow); r <= std::min(image.rows - 1, row + rowWindow); r++)
+					for(int c = col - colWindow; c <= col + colWindow; c++)
+					{
+						// azimuth wraps around
+						int other = image.cell(r, (c + image.cols) % image.cols);
+						if(image.index[other] < 0 || label[other] >= 0 || (hasGround && image.ground[other]))
+							continue;
+						const auto &neighbour = points[image.index[other]];
+						float dx = neighbour.x - point.x, dy = neighbour.y - point.y, dz = neighbour.z - point.z;
+						if(dx*dx + dy*dy + dz*dz <= tolSquared)
+						{
+							label[other] = id;
+							queue.push_back(other);
+						}
+					}
+			}
+
+			// a cluster covers at most as many voxels as it has cells
+			int size = queue.size();
+			if(sizeVoxel > 0 && size >= minSize)
+				size = clusterVoxels(points, image, sizeVoxel);
+			if(size < minSize || size > maxSize)
+			{
+				// cells stay labelled so they are not grown again, like the visited points of a kd-tree search
+				for(int cell : queue)
+					label[cell] = numCells;
+				continue;
+			}
+			for(int cell : queue)
+				indices.push_back(image.index[cell]);
+			std::sort(indices.begin() + offsets.back(), indices.end());
+			offsets.push_back(indices.size());
+		}
+		return numClusters();
+	}
+
+	// Distinct voxels of edge sizeVoxel, aligned to floor(x / sizeVoxel), the points of queue fall into
+	template<typename Points>
+	int clusterVoxels(const Points &points, const RangeImage &image, float sizeVoxel)
+	{
+		const float inverseVoxel = 1/sizeVoxel;
+		voxelKeys.clear();
+		for(int cell : queue)
+		{
+			const auto &point = points[image.index[cell]];
+			// 21 bits per axis, offset so negative coordinates stay positive
+			uint64_t ix = (uint64_t)((int64_t)floorf(point.x*inverseVoxel) + (1 << 20)) & 0x1FFFFF;
+			uint64_t iy = (uint64_t)((int64_t)floorf(point.y*inverseVoxel) + (1 << 20)) & 0x1FFFFF;
+			uint64_t iz = (uint64_t)((int64_t)floorf(point.z*inverseVoxel) + (1 << 20)) & 0x1FFFFF;
+			voxelKeys.push_back(ix | iy << 21 | iz << 42);
+		}
+		std::sort(voxelKeys.begin(), voxelKeys.end());
+		return std::unique(voxelKeys.begin(), voxelKeys.end()) - voxelKeys.begin();
+	}
+};
+
+#endif /* RANGE_SEGMENTATION_H */
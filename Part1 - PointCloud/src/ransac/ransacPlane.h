@@ -0,0 +1,287 @@
+// Multithreaded RANSAC plane segmentation with vectorized inlier counting
+
+#ifndef RANSAC_PLANE_H
+#define RANSAC_PLANE_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../utils/random.h"
+
+// Points are counted in blocks so a hypothesis that can no longer beat the best model stops early
+#define RANSAC_BLOCK_SIZE 4096
+// hypothesisCounts entry of a hypothesis no thread has finished yet
+#define RANSAC_PENDING -2
+
+// Count points within distanceTol of the plane a*x + b*y + c*z + d = 0 with (a,b,c) of unit length
+inline int countPlaneInliers(const float *x, const float *y, const float *z, int begin, int end, const float *plane, float distanceTol)
+{
+	int count = 0;
+	int i = begin;
+#if defined(__SSE2__)
+	const __m128 a = _mm_set1_ps(plane[0]);
+	const __m128 b = _mm_set1_ps(plane[1]);
+	const __m128 c = _mm_set1_ps(plane[2]);
+	const __m128 d = _mm_set1_ps(plane[3]);
+	const __m128 tol = _mm_set1_ps(distanceTol);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	// every lane of the comparison mask is -1 for an inlier, so subtracting it counts
+	__m128i counts = _mm_setzero_si128();
+	for(; i + 4 <= end; i += 4)
+	{
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)), _mm_mul_ps(b, _mm_loadu_ps(y + i))),
+		                             _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(z + i)), d));
+		__m128 isInlier = _mm_cmple_ps(_mm_and_ps(distance, absMask), tol);
+		counts = _mm_sub_epi32(counts, _mm_castps_si128(isInlier));
+	}
+	int32_t lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, counts);
+	count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+	for(; i < end; i++)
+		count += fabsf(plane[0]*x[i] + plane[1]*y[i] + plane[2]*z[i] + plane[3]) <= distanceTol;
+	return count;
+}
+
+// mask[i] = 1 for points within distanceTol of the plane and 0 for the others, returns the inliers
+inline int planeInlierMask(const float *x, const float *y, const float *z, int numPoints, const float *plane, float distanceTol, uint8_t *mask)
+{
+	int count = 0;
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 a = _mm_set1_ps(plane[0]);
+	const __m128 b = _mm_set1_ps(plane[1]);
+	const __m128 c = _mm_set1_ps(plane[2]);
+	const __m128 d = _mm_set1_ps(plane[3]);
+	const __m128 tol = _mm_set1_ps(distanceTol);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	for(; i + 4 <= numPoints; i += 4)
+	{
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)), _mm_mul_ps(b, _mm_loadu_ps(y + i))),
+		                             _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(z + i)), d));
+		int bits = _mm_movemask_ps(_mm_cmple_ps(_mm_and_ps(distance, absMask), tol));
+		mask[i] = bits & 1;
+		mask[i+1] = (bits >> 1) & 1;
+		mask[i+2] = (bits >> 2) & 1;
+		mask[i+3] = (bits >> 3) & 1;
+		count += mask[i] + mask[i+1] + mask[i+2] + mask[i+3];
+	}
+#endif
+	for(; i < numPoints; i++)
+	{
+		mask[i] = fabsf(plane[0]*x[i] + plane[1]*y[i] + plane[2]*z[i] + plane[3]) <= distanceTol;
+		count += mask[i];
+	}
+	return count;
+}
+
+struct RansacPlane
+{
+	// SoA copy of the cloud, unused when the columns come from setInputColumns
+	std::vector<float> x, y, z;
+	// columns segment() runs on and their length
+	const float *xs, *ys, *zs;
+	int numInput;
+	// best plane of the last segment() call, a*x + b*y + c*z + d = 0
+	float coefficients[4];
+	// and its number of inliers, 0 when no plane was found
+	int bestInliers;
+	int numThreads;
+	// probability that at least one sample is outlier free, drives the early stop
+	float probability;
+	// the same seed and input give the same plane, whatever numThreads is
+	uint64_t seed;
+
+	RansacPlane()
+	: xs(NULL), ys(NULL), zs(NULL), numInput(0), bestInliers(0),
+	  numThreads(std::max(1u, std::thread::hardware_concurrency())), probability(0.99), seed(0)
+	{
+		std::fill(coefficients, coefficients + 4, 0.0f);
+	}
+
+	// points: any container of PCL-like points with x, y, z members, e.g. pcl::PointCloud<PointT>::points
+	template<typename Points>
+	void setInputCloud(const Points& points)
+	{
+		int numPoints = points.size();
+		x.resize(numPoints);
+		y.resize(numPoints);
+		z.resize(numPoints);
+		for(int i = 0; i < numPoints; i++)
+		{
+			x[i] = points[i].x;
+			y[i] = points[i].y;
+			z[i] = points[i].z;
+		}
+		setInputColumns(x.data(), y.data(), z.data(), numPoints);
+	}
+
+	// Columns already laid out as SoA, e.g. by SoaCloud, are used in place without a copy.
+	// They have to stay alive until segment() returns.
+	void setInputColumns(const float *setX, const float *setY, const float *setZ, int numPoints)
+	{
+		xs = setX;
+		ys = setY;
+		zs = setZ;
+		numInput = numPoints;
+	}
+
+	// Plane through three random points, returns false for a degenerate (collinear) sample.
+	// Hypothesis h draws from stream h of seed, the same sample whichever thread runs it.
+	bool hypothesis(int h, float *plane) const
+	{
+		RandomStream random(seed, h);
+		int i1 = random.below(numInput);
+		int i2 = random.below(numInput);
+		int i3 = random.below(numInput);
+		if(i1 == i2 || i1 == i3 || i2 == i3)
+			return false;
+
+		float v1x = xs[i2] - xs[i1], v1y = ys[i2] - ys[i1], v1z = zs[i2] - zs[i1];
+		float v2x = xs[i3] - xs[i1], v2y = ys[i3] - ys[i1], v2z = zs[i3] - zs[i1];
+		float a = v1y*v2z - v1z*v2y;
+		float b = v1z*v2x - v1x*v2z;
+		float c = v1x*v2y - v1y*v2x;
+		float norm = sqrtf(a*a + b*b + c*c);
+		if(norm < 1e-6f)
+			return false;
+
+		plane[0] = a/norm;
+		plane[1] = b/norm;
+		plane[2] = c/norm;
+		plane[3] = -(plane[0]*xs[i1] + plane[1]*ys[i1] + plane[2]*zs[i1]);
+		return true;
+	}
+
+	// Number of hypotheses after which an outlier free sample was drawn with the wanted probability
+	int requiredIterations(int numInliers, int maxIterations) const
+	{
+		double inlierRatio = (double)numInliers / numInput;
+		double allInliers = inlierRatio*inlierRatio*inlierRatio;
+		if(allInliers <= 0)
+			return maxIterations;
+		if(allInliers >= 1)
+			return 1;
+		double iterations = log(1.0 - probability) / log(1.0 - allInliers);
+		return (int)std::min<double>(ceil(iterations), maxIterations);
+	}
+
+	// Fit a plane to the input cloud, fills inliers with the indices of the best model only.
+	// Returns the number of hypotheses evaluated.
+	int segment(int maxIterations, float distanceTol, std::vector<int> &inliers)
+	{
+		inliers.clear();
+		int numIterations = fit(maxIterations, distanceTol);
+		if(bestInliers <= 0)
+			return numIterations;
+
+		inliers.reserve(bestInliers);
+		for(int i = 0; i < numInput; i++)
+			if(fabsf(coefficients[0]*xs[i] + coefficients[1]*ys[i] + coefficients[2]*zs[i] + coefficients[3]) <= distanceTol)
+				inliers.push_back(i);
+		return numIterations;
+	}
+
+	// Same fit, the result is mask[i] = 1 for the inliers of the best model and 0 for the others.
+	// mask has to hold one byte per input point. Returns the number of inliers.
+	int segment(int maxIterations, float distanceTol, uint8_t *mask)
+	{
+		fit(maxIterations, distanceTol);
+		if(bestInliers <= 0)
+		{
+			std::fill(mask, mask + numInput, 0);
+			return 0;
+		}
+		return planeInlierMask(xs, ys, zs, numInput, coefficients, distanceTol, mask);
+	}
+
+private:
+
+	// Best plane into coefficients and its inlier count into bestInliers, returns the hypotheses evaluated.
+	// Threads evaluate hypotheses in any order, but only a replay of the finished ones in hypothesis order
+	// picks the best plane and lowers the iteration limit, exactly like a single thread would. Hypotheses
+	// a thread took beyond the limit the replay ends at are ignored, so the plane never depends on timing.
+	int fit(int maxIterations, float distanceTol)
+	{
+		bestInliers = 0;
+		int numPoints = numInput;
+		if(numPoints < 3 || maxIterations <= 0)
+			return 0;
+
+		hypothesisCounts.assign(maxIterations, RANSAC_PENDING);
+		hypothesisPlanes.resize(4*maxIterations);
+		std::atomic<int> nextHypothesis(0);
+		// limit and best of the replayed prefix, read by the threads without the lock
+		std::atomic<int> iterationLimit(maxIterations);
+		std::atomic<int> bestCount(-1);
+		// replay state, guarded by replayMutex
+		int replayed = 0, limit = maxIterations, best = -1, bestHypothesis = -1;
+		std::mutex replayMutex;
+
+		auto worker = [&]()
+		{
+			int h;
+			while((h = nextHypothesis.fetch_add(1)) < iterationLimit.load())
+			{
+				float *plane = &hypothesisPlanes[4*h];
+				int count = -1;
+				if(hypothesis(h, plane))
+				{
+					count = 0;
+					// a count stopped early is below the replayed best, which only grows until h is replayed
+					for(int begin = 0; begin < numPoints; begin += RANSAC_BLOCK_SIZE)
+					{
+						int end = std::min(begin + RANSAC_BLOCK_SIZE, numPoints);
+						count += countPlaneInliers(xs, ys, zs, begin, end, plane, distanceTol);
+						if(count + (numPoints - end) < bestCount.load(std::memory_order_relaxed))
+							break;
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(replayMutex);
+				hypothesisCounts[h] = count;
+				// strictly better only, ties stay with the lower hypothesis
+				while(replayed < limit && hypothesisCounts[replayed] != RANSAC_PENDING)
+				{
+					if(hypothesisCounts[replayed] > best)
+					{
+						best = hypothesisCounts[replayed];
+						bestHypothesis = replayed;
+						limit = std::min(limit, requiredIterations(best, maxIterations));
+					}
+					replayed++;
+				}
+				bestCount = best;
+				iterationLimit = limit;
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(int t = 1; t < numThreads; t++)
+			threads.push_back(std::thread(worker));
+		worker();
+		for(std::thread &thread : threads)
+			thread.join();
+
+		if(best <= 0)
+			return replayed;
+
+		std::copy(&hypothesisPlanes[4*bestHypothesis], &hypothesisPlanes[4*bestHypothesis] + 4, coefficients);
+		bestInliers = best;
+		return replayed;
+	}
+
+	// inlier count of every hypothesis of the last fit, -1 for a degenerate sample, and its plane
+	std::vector<int> hypothesisCounts;
+	std::vector<float> hypothesisPlanes;
+
+};
+
+#endif /* RANSAC_PLANE_H */
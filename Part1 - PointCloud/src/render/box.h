@@ -1,6 +1,9 @@
 #ifndef BOX_H
 #define BOX_H
 #include <Eigen/Geometry> 
+#include <Eigen/StdVector>
+#include <vector>
+#include <cmath>
 
 struct BoxQ
 {
@@ -10,6 +13,9 @@ struct BoxQ
     float cube_width;
     float cube_height;
 };
+// BoxQ has fixed size vectorizable Eigen members, std::vector needs the aligned allocator
+typedef std::vector<BoxQ, Eigen::aligned_allocator<BoxQ> > BoxQVector;
+
 struct Box
 {
 	float x_min;
@@ -19,4 +25,39 @@ struct Box
 	float y_max;
 	float z_max;
 };
+
+// Box center, extents and heading about z, axis aligned boxes have yaw 0
+struct BoxRecord
+{
+	float x, y, z;
+	float length, width, height;
+	float yaw;
+};
+
+inline BoxRecord toBoxRecord(const Box &box)
+{
+	BoxRecord record;
+	record.x = (box.x_min + box.x_max)/2;
+	record.y = (box.y_min + box.y_max)/2;
+	record.z = (box.z_min + box.z_max)/2;
+	record.length = box.x_max - box.x_min;
+	record.width = box.y_max - box.y_min;
+	record.height = box.z_max - box.z_min;
+	record.yaw = 0;
+	return record;
+}
+
+inline BoxRecord toBoxRecord(const BoxQ &box)
+{
+	BoxRecord record;
+	record.x = box.bboxTransform.x();
+	record.y = box.bboxTransform.y();
+	record.z = box.bboxTransform.z();
+	record.length = box.cube_length;
+	record.width = box.cube_width;
+	record.height = box.cube_height;
+	// BoxQ only ever rotates about z
+	record.yaw = 2*atan2f(box.bboxQuaternion.z(), box.bboxQuaternion.w());
+	return record;
+}
 #endif
\ No newline at end of file
@@ -67,6 +67,44 @@ void renderPointCloud(pcl::visualization::PCLVisualizer::Ptr& viewer, const pcl:
 	viewer->setPointCloudRenderingProperties (pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 2, name);
 }
 
+// Colors every cluster range of the shared buffer, the viewer then needs a single cloud instead of one per cluster
+template<typename PointT>
+void renderClusterSet(pcl::visualization::PCLVisualizer::Ptr& viewer, const ClusterSet<PointT>& clusters, std::string name, const std::vector<Color>& colors, int pointSize)
+{
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr colored (new pcl::PointCloud<pcl::PointXYZRGB>);
+	colored->points.resize(clusters.points.size());
+	for(int cluster = 0; cluster < clusters.size(); cluster++)
+	{
+		const Color& color = colors[cluster % colors.size()];
+		for(int index = clusters.offsets[cluster]; index < clusters.offsets[cluster+1]; index++)
+		{
+			pcl::PointXYZRGB& point = colored->points[index];
+			point.x = clusters.points[index].x;
+			point.y = clusters.points[index].y;
+			point.z = clusters.points[index].z;
+			point.r = color.r*255;
+			point.g = color.g*255;
+			point.b = color.b*255;
+		}
+	}
+	colored->width = colored->points.size();
+	colored->height = 1;
+
+	pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> rgb(colored);
+	viewer->addPointCloud<pcl::PointXYZRGB>(colored, rgb, name);
+	viewer->setPointCloudRenderingProperties (pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, name);
+}
+
+void renderClusters(pcl::visualization::PCLVisualizer::Ptr& viewer, const ClusterSet<pcl::PointXYZ>& clusters, std::string name, const std::vector<Color>& colors)
+{
+	renderClusterSet(viewer, clusters, name, colors, 4);
+}
+
+void renderClusters(pcl::visualization::PCLVisualizer::Ptr& viewer, const ClusterSet<pcl::PointXYZI>& clusters, std::string name, const std::vector<Color>& colors)
+{
+	renderClusterSet(viewer, clusters, name, colors, 2);
+}
+
 // Draw wire frame box with filled transparent color 
 void renderBox(pcl::visualization::PCLVisualizer::Ptr& viewer, Box box, int id, Color color, float opacity)
 {
@@ -6,6 +6,7 @@
 #define RENDER_H
 #include <pcl/visualization/pcl_visualizer.h>
 #include "box.h"
+#include "../cluster/clusterSet.h"
 #include <iostream>
 #include <vector>
 #include <string>
@@ -69,12 +70,12 @@ struct Car
 	}
 
 	// collision helper function
-	bool inbetween(double point, double center, double range)
+	bool inbetween(double point, double center, double range) const
 	{
 		return (center-range <= point) && (center+range >= point);
 	}
 
-	bool checkCollision(Vect3 point)
+	bool checkCollision(const Vect3& point) const
 	{
 		return (inbetween(point.x,position.x,dimensions.x/2)&&inbetween(point.y,position.y,dimensions.y/2)&&inbetween(point.z,position.z+dimensions.z/3,dimensions.z/3))||
 			   (inbetween(point.x,position.x,dimensions.x/4)&&inbetween(point.y,position.y,dimensions.y/2)&&inbetween(point.z,position.z+dimensions.z*5/6,dimensions.z/6));
@@ -87,6 +88,9 @@ void renderRays(pcl::visualization::PCLVisualizer::Ptr& viewer, const Vect3& ori
 void clearRays(pcl::visualization::PCLVisualizer::Ptr& viewer);
 void renderPointCloud(pcl::visualization::PCLVisualizer::Ptr& viewer, const pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, std::string name, Color color = Color(1,1,1));
 void renderPointCloud(pcl::visualization::PCLVisualizer::Ptr& viewer, const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud, std::string name, Color color = Color(-1,-1,-1));
+// All clusters in one cloud, cluster c is drawn in colors[c % colors.size()]
+void renderClusters(pcl::visualization::PCLVisualizer::Ptr& viewer, const ClusterSet<pcl::PointXYZ>& clusters, std::string name, const std::vector<Color>& colors);
+void renderClusters(pcl::visualization::PCLVisualizer::Ptr& viewer, const ClusterSet<pcl::PointXYZI>& clusters, std::string name, const std::vector<Color>& colors);
 void renderBox(pcl::visualization::PCLVisualizer::Ptr& viewer, Box box, int id, Color color = Color(1,0,0), float opacity=1);
 void renderBox(pcl::visualization::PCLVisualizer::Ptr& viewer, BoxQ box, int id, Color color = Color(1,0,0), float opacity=1);
 
@@ -1,11 +1,11 @@
 #ifndef LIDAR_H
 #define LIDAR_H
 #include "../render/render.h"
+#include "rayCaster.h"
+#include "lidarProfile.h"
 #include <ctime>
 #include <chrono>
 
-const double pi = 3.1415;
-
 struct Ray
 {
 	
@@ -27,13 +27,16 @@ struct Ray
 		  castPosition(origin), castDistance(0)
 	{}
 
-	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	// noise: stream the noise of the point is drawn from, shared by the rays of a scan
+	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr,
+	             RandomStream& noise)
 	{
 		// reset ray
 		castPosition = origin;
 		castDistance = 0;
 
 		bool collision = false;
+		const double groundTan = tan(slopeAngle);
 
 		while(!collision && castDistance < maxDistance)
 		{
@@ -42,12 +45,12 @@ struct Ray
 			castDistance += resolution;
 
 			// check if there is any collisions with ground slope
-			collision = (castPosition.z <= castPosition.x * tan(slopeAngle));
+			collision = (castPosition.z <= castPosition.x * groundTan);
 
 			// check if there is any collisions with cars
 			if(!collision && castDistance < maxDistance)
 			{
-				for(Car car : cars)
+				for(const Car& car : cars)
 				{
 					collision |= car.checkCollision(castPosition);
 					if(collision)
@@ -59,9 +62,9 @@ struct Ray
 		if((castDistance >= minDistance)&&(castDistance<=maxDistance))
 		{
 			// add noise based on standard deviation error
-			double rx = ((double) rand() / (RAND_MAX));
-			double ry = ((double) rand() / (RAND_MAX));
-			double rz = ((double) rand() / (RAND_MAX));
+			double rx = noise.uniform();
+			double ry = noise.uniform();
+			double rz = noise.uniform();
 			cloud->points.push_back(pcl::PointXYZ(castPosition.x+rx*sderr, castPosition.y+ry*sderr, castPosition.z+rz*sderr));
 		}
 			
@@ -81,6 +84,8 @@ struct Lidar
 	double maxDistance;
 	double resoultion;
 	double sderr;
+	// analytic engine behind scan(), holds the same rays as rays
+	RayCaster caster;
 
 	Lidar(std::vector<Car> setCars, double setGroundSlope)
 		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,2.6)
@@ -106,13 +111,31 @@ struct Lidar
 		double angleIncrement = angleRange/numLayers;
 
 		for(double angleVertical = steepestAngle; angleVertical < steepestAngle+angleRange; angleVertical+=angleIncrement)
-		{
-			for(double angle = 0; angle <= 2*pi; angle+=horizontalAngleInc)
-			{
-				Ray ray(position,angle,angleVertical,resoultion);
-				rays.push_back(ray);
-			}
-		}
+			addLayer(angleVertical, horizontalAngleInc, 2*pi);
+	}
+
+	// Sensor described by profile, one layer per entry of its vertical angle table
+	Lidar(std::vector<Car> setCars, double setGroundSlope, const LidarProfile& profile)
+		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,profile.height)
+	{
+		minDistance = profile.minDistance;
+		maxDistance = profile.maxDistance;
+		resoultion = 0.2;
+		sderr = profile.sderr;
+		cars = setCars;
+		groundSlope = setGroundSlope;
+
+		// a full turn without repeating the ray at angle 0
+		double horizontalAngleInc = profile.horizontalResolution*(pi/180);
+		for(double angleVertical : profile.verticalAngles)
+			addLayer(angleVertical*(pi/180), horizontalAngleInc, 2*pi - horizontalAngleInc/2);
+	}
+
+	// Noise of every later scan follows from seed, the same seed replays the same scans
+	void setSeed(uint64_t seed)
+	{
+		caster.seed = seed;
+		caster.scanCount = 0;
 	}
 
 	~Lidar()
@@ -120,12 +143,54 @@ struct Lidar
 		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
 	}
 
+	// Cars as the boxes the ray caster intersects, the same two parts Car::checkCollision tests
+	std::vector<CastBox> carBoxes() const
+	{
+		std::vector<CastBox> boxes;
+		for(const Car& car : cars)
+		{
+			const Vect3 &p = car.position, &d = car.dimensions;
+			CastBox bottom = {{(float)(p.x-d.x/2), (float)(p.y-d.y/2), (float)p.z}, {(float)(p.x+d.x/2), (float)(p.y+d.y/2), (float)(p.z+d.z*2/3)}};
+			CastBox top = {{(float)(p.x-d.x/4), (float)(p.y-d.y/2), (float)(p.z+d.z*2/3)}, {(float)(p.x+d.x/4), (float)(p.y+d.y/2), (float)(p.z+d.z)}};
+			boxes.push_back(bottom);
+			boxes.push_back(top);
+		}
+		return boxes;
+	}
+
 	pcl::PointCloud<pcl::PointXYZ>::Ptr scan()
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		float origin[3] = {(float)position.x, (float)position.y, (float)position.z};
+		caster.scan(origin, tan(groundSlope), carBoxes(), minDistance, maxDistance, sderr, *cloud);
+		auto endTime = std::chrono::steady_clock::now();
+		auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+		cout << "ray casting took " << elapsedTime.count() << " microseconds for " << caster.numRays() << " rays" << endl;
+		return cloud;
+	}
+
+	// Scan that also fills image, a ring per layer sorted by elevation and a column per azimuth step
+	pcl::PointCloud<pcl::PointXYZ>::Ptr scan(RangeImage& image)
+	{
+		scan();
+		if(image.rows != caster.numLayers())
+			caster.imageLayout(image);
+		image.origin[0] = position.x;
+		image.origin[1] = position.y;
+		image.origin[2] = position.z;
+		caster.fillImage(image);
+		return cloud;
+	}
+
+	// Original fixed step ray marching, kept as the reference for the analytic caster
+	pcl::PointCloud<pcl::PointXYZ>::Ptr scanMarching()
 	{
 		cloud->points.clear();
 		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+		// one stream per scan, under the caster's seed like the analytic scans
+		RandomStream noise(caster.seed, caster.scanCount++);
+		for(Ray& ray : rays)
+			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr, noise);
 		auto endTime = std::chrono::steady_clock::now();
 		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
 		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
@@ -134,6 +199,19 @@ struct Lidar
 		return cloud;
 	}
 
+private:
+
+	// Rays of one layer for both the marching reference and the analytic caster
+	void addLayer(double angleVertical, double horizontalAngleInc, double horizontalEnd)
+	{
+		caster.addLayer(angleVertical, horizontalAngleInc, horizontalEnd);
+		for(double angle = 0; angle <= horizontalEnd; angle+=horizontalAngleInc)
+		{
+			Ray ray(position,angle,angleVertical,resoultion);
+			rays.push_back(ray);
+		}
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Sensor profiles for the simulated Lidar, read from a config file such as lidarProfiles.cfg
+
+#ifndef LIDAR_PROFILE_H
+#define LIDAR_PROFILE_H
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct LidarProfile
+{
+	std::string name;
+	// returns outside [minDistance, maxDistance] are dropped, meters
+	double minDistance;
+	double maxDistance;
+	// noise added to every axis of a return, meters
+	double sderr;
+	// azimuth step, degrees
+	double horizontalResolution;
+	// mount height above the ground, meters
+	double height;
+	// elevation of every beam, degrees
+	std::vector<double> verticalAngles;
+
+	LidarProfile()
+	: minDistance(5), maxDistance(50), sderr(0.2), horizontalResolution(180.0/64), height(2.6)
+	{}
+};
+
+// Parse every PROFILE block of file into profiles, false if the file can't be read or a profile has no beams
+inline bool loadLidarProfiles(const std::string &file, std::vector<LidarProfile> &profiles)
+{
+	std::ifstream in(file.c_str());
+	if(!in)
+	{
+		std::cerr << "Couldn't read lidar profiles " << file << std::endl;
+		return false;
+	}
+
+	std::string text, line;
+	while(std::getline(in, line))
+	{
+		// a trailing backslash continues the line
+		size_t end = line.find_last_not_of(" \t\r");
+		if(end != std::string::npos && line[end] == '\\')
+		{
+			text += line.substr(0, end) + " ";
+			continue;
+		}
+		text += line;
+
+		std::istringstream tokens(text);
+		text.clear();
+		std::string key;
+		tokens >> key;
+		if(key.empty() || key[0] == '#')
+			continue;
+
+		if(key == "PROFILE")
+		{
+			profiles.push_back(LidarProfile());
+			tokens >> profiles.back().name;
+			continue;
+		}
+		if(profiles.empty())
+		{
+			std::cerr << file << ": " << key << " before the first PROFILE" << std::endl;
+			return false;
+		}
+
+		LidarProfile &profile = profiles.back();
+		if(key == "MIN_RANGE")
+			tokens >> profile.minDistance;
+		else if(key == "MAX_RANGE")
+			tokens >> profile.maxDistance;
+		else if(key == "NOISE")
+			tokens >> profile.sderr;
+		else if(key == "HORIZONTAL_RESOLUTION")
+			tokens >> profile.horizontalResolution;
+		else if(key == "HEIGHT")
+			tokens >> profile.height;
+		else if(key == "VERTICAL_ANGLES")
+		{
+			double angle;
+			while(tokens >> angle)
+				profile.verticalAngles.push_back(angle);
+		}
+		else
+			std::cerr << file << ": unknown key " << key << std::endl;
+	}
+
+	for(const LidarProfile &profile : profiles)
+		if(profile.verticalAngles.empty() || profile.horizontalResolution <= 0)
+		{
+			std::cerr << file << ": profile " << profile.name << " needs VERTICAL_ANGLES and a positive HORIZONTAL_RESOLUTION" << std::endl;
+			return false;
+		}
+	return true;
+}
+
+// Profile called name in file
+inline bool loadLidarProfile(const std::string &file, const std::string &name, LidarProfile &profile)
+{
+	std::vector<LidarProfile> profiles;
+	if(!loadLidarProfiles(file, profiles))
+		return false;
+	for(const LidarProfile &candidate : profiles)
+		if(candidate.name == name)
+		{
+			profile = candidate;
+			return true;
+		}
+	std::cerr << "No lidar profile " << name << " in " << file << std::endl;
+	return false;
+}
+
+#endif /* LIDAR_PROFILE_H */
@@ -0,0 +1,234 @@
+// Analytic ray caster for the simulated Lidar: every ray is intersected with the sloped ground
+// plane and the boxes of the cars in closed form instead of being marched in fixed steps.
+// Rays are processed four at a time with SSE2, layers are spread over threads.
+
+#ifndef RAY_CASTER_H
+#define RAY_CASTER_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <stdint.h>
+#include "../range/rangeImage.h"
+#include "../utils/random.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Angle constant of the simulator, Lidar builds its rays with it too so both sweep the same angles
+const double pi = 3.1415;
+
+// Axis aligned box a ray can hit, cars are made of two of them
+struct CastBox
+{
+	float min[3];
+	float max[3];
+};
+
+// Distance along the unit direction d from origin o to the first hit, infinity for a miss.
+// inv is 1/d per axis, ground is the plane z = x*tanSlope.
+inline float castRay(const float *o, const float *d, const float *inv, float tanSlope, const CastBox *boxes, int numBoxes)
+{
+	float hit = std::numeric_limits<float>::infinity();
+
+	float denominator = d[0]*tanSlope - d[2];
+	float ground = (o[2] - o[0]*tanSlope) / denominator;
+	if(denominator > 0 && ground >= 0)
+		hit = ground;
+
+	for(int b = 0; b < numBoxes; b++)
+	{
+		// slab test, entry is the latest of the three entries and exit the earliest exit
+		float entry = 0, exit = hit;
+		for(int axis = 0; axis < 3; axis++)
+		{
+			float t1 = (boxes[b].min[axis] - o[axis]) * inv[axis];
+			float t2 = (boxes[b].max[axis] - o[axis]) * inv[axis];
+			entry = std::max(entry, std::min(t1, t2));
+			exit = std::min(exit, std::max(t1, t2));
+		}
+		if(entry <= exit)
+			hit = entry;
+	}
+	return hit;
+}
+
+// castRay for rays [begin, end) given as SoA directions, distances go to hit[begin, end)
+inline void castRays(const float *dx, const float *dy, const float *dz, const float *invX, const float *invY, const float *invZ,
+                     int begin, int end, const float *o, float tanSlope, const CastBox *boxes, int numBoxes, float *hit)
+{
+	int i = begin;
+#if defined(__SSE2__)
+	const __m128 ox = _mm_set1_ps(o[0]), oy = _mm_set1_ps(o[1]), oz = _mm_set1_ps(o[2]);
+	const __m128 slope = _mm_set1_ps(tanSlope);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	for(; i + 4 <= end; i += 4)
+	{
+		__m128 denominator = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(dx + i), slope), _mm_loadu_ps(dz + i));
+		__m128 ground = _mm_div_ps(_mm_sub_ps(oz, _mm_mul_ps(ox, slope)), denominator);
+		__m128 isGround = _mm_and_ps(_mm_cmpgt_ps(denominator, zero), _mm_cmpge_ps(ground, zero));
+		__m128 t = _mm_or_ps(_mm_and_ps(isGround, ground), _mm_andnot_ps(isGround, infinity));
+
+		const __m128 ix = _mm_loadu_ps(invX + i), iy = _mm_loadu_ps(invY + i), iz = _mm_loadu_ps(invZ + i);
+		for(int b = 0; b < numBoxes; b++)
+		{
+			__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].min[0]), ox), ix);
+			__m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].max[0]), ox), ix);
+			__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].min[1]), oy), iy);
+			__m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].max[1]), oy), iy);
+			__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].min[2]), oz), iz);
+			__m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxes[b].max[2]), oz), iz);
+			__m128 entry = _mm_max_ps(_mm_max_ps(zero, _mm_min_ps(tx1, tx2)), _mm_max_ps(_mm_min_ps(ty1, ty2), _mm_min_ps(tz1, tz2)));
+			__m128 exit = _mm_min_ps(_mm_min_ps(t, _mm_max_ps(tx1, tx2)), _mm_min_ps(_mm_max_ps(ty1, ty2), _mm_max_ps(tz1, tz2)));
+			__m128 isHit = _mm_cmple_ps(entry, exit);
+			t = _mm_or_ps(_mm_and_ps(isHit, entry), _mm_andnot_ps(isHit, t));
+		}
+		_mm_storeu_ps(hit + i, t);
+	}
+#endif
+	for(; i < end; i++)
+	{
+		float d[3] = {dx[i], dy[i], dz[i]};
+		float inv[3] = {invX[i], invY[i], invZ[i]};
+		hit[i] = castRay(o, d, inv, tanSlope, boxes, numBoxes);
+	}
+}
+
+struct RayCaster
+{
+	// unit direction and its reciprocal per ray, SoA so four rays load at once
+	std::vector<float> dirX, dirY, dirZ;
+	std::vector<float> invX, invY, invZ;
+	// layer l is rays [layerOffsets[l], layerOffsets[l+1])
+	std::vector<int> layerOffsets;
+	// hit distance per ray of the last scan
+	std::vector<float> hit;
+	// ray of every point of the last scan's cloud
+	std::vector<int> keptRays;
+	int numThreads;
+	// noise of layer l in a scan is drawn from stream l of a seed made of seed and the scan count,
+	// so a scan is the same whatever the number of threads
+	uint64_t seed;
+	uint64_t scanCount;
+
+	RayCaster()
+	: layerOffsets(1, 0), numThreads(std::max(1u, std::thread::hardware_concurrency())), seed(0), scanCount(0)
+	{}
+
+	int numLayers() const
+	{
+		return layerOffsets.size() - 1;
+	}
+
+	int numRays() const
+	{
+		return dirX.size();
+	}
+
+	// One layer of rays sweeping the horizontal angle from 0 up to and including horizontalEnd
+	void addLayer(double verticalAngle, double horizontalAngleInc, double horizontalEnd = 2*pi)
+	{
+		for(double angle = 0; angle <= horizontalEnd; angle += horizontalAngleInc)
+		{
+			dirX.push_back(cos(verticalAngle)*cos(angle));
+			dirY.push_back(cos(verticalAngle)*sin(angle));
+			dirZ.push_back(sin(verticalAngle));
+		}
+		for(size_t i = invX.size(); i < dirX.size(); i++)
+		{
+			// a zero component would give 0 * inf in the slab test, a huge finite reciprocal behaves the same without nans
+			invX.push_back(1.0f / (fabsf(dirX[i]) > 1e-20f ? dirX[i] : 1e-20f));
+			invY.push_back(1.0f / (fabsf(dirY[i]) > 1e-20f ? dirY[i] : 1e-20f));
+			invZ.push_back(1.0f / (fabsf(dirZ[i]) > 1e-20f ? dirZ[i] : 1e-20f));
+		}
+		layerOffsets.push_back(dirX.size());
+	}
+
+	// Organized layout of the rays: a row per layer and a column per ray of the widest layer
+	void imageLayout(RangeImage &image) const
+	{
+		std::vector<double> elevationDegrees;
+		int cols = 0;
+		for(int layer = 0; layer < numLayers(); layer++)
+		{
+			elevationDegrees.push_back(asin(dirZ[layerOffsets[layer]])*180/pi);
+			cols = std::max(cols, layerOffsets[layer+1] - layerOffsets[layer]);
+		}
+		image.setRings(elevationDegrees, 360.0/std::max(cols, 1));
+	}
+
+	// Cells of the points of the last scan, ring from the layer and column from the ray's place in it
+	void fillImage(RangeImage &image) const
+	{
+		image.clear();
+		int layer = 0;
+		for(size_t id = 0; id < keptRays.size(); id++)
+		{
+			// keptRays is ascending, so is the layer
+			while(keptRays[id] >= layerOffsets[layer+1])
+				layer++;
+			int row = image.rowOf(asinf(dirZ[keptRays[id]]));
+			image.set(image.cell(row, keptRays[id] - layerOffsets[layer]), id, hit[keptRays[id]]);
+		}
+	}
+
+	// Points with hit distance in [minDistance, maxDistance] go to cloud in ray order with uniform noise in [0, sderr)
+	// on every axis as the Ray based Lidar adds. cloud keeps its capacity so repeated scans do not allocate.
+	void scan(const float *origin, float tanSlope, const std::vector<CastBox> &boxes, float minDistance, float maxDistance, float sderr,
+	          pcl::PointCloud<pcl::PointXYZ> &cloud)
+	{
+		int rays = numRays();
+		hit.resize(rays);
+		cloud.points.resize(rays);
+		uint64_t scanSeed = seed + scanCount++ * 0x9e3779b97f4a7c15ULL;
+
+		// the output slot of every ray is its index, misses are compacted afterwards
+		std::atomic<int> nextLayer(0);
+		auto worker = [&]()
+		{
+			for(int layer = nextLayer++; layer < numLayers(); layer = nextLayer++)
+			{
+				int begin = layerOffsets[layer], end = layerOffsets[layer+1];
+				castRays(&dirX[0], &dirY[0], &dirZ[0], &invX[0], &invY[0], &invZ[0], begin, end, origin, tanSlope,
+				         boxes.empty() ? NULL : &boxes[0], boxes.size(), &hit[0]);
+
+				RandomStream noise(scanSeed, layer);
+				for(int i = begin; i < end; i++)
+				{
+					pcl::PointXYZ &point = cloud.points[i];
+					point.x = origin[0] + hit[i]*dirX[i] + noise.uniform(0, sderr);
+					point.y = origin[1] + hit[i]*dirY[i] + noise.uniform(0, sderr);
+					point.z = origin[2] + hit[i]*dirZ[i] + noise.uniform(0, sderr);
+				}
+			}
+		};
+
+		int threadsUsed = std::min(numThreads, numLayers());
+		std::vector<std::thread> threads;
+		for(int t = 1; t < threadsUsed; t++)
+			threads.push_back(std::thread(worker));
+		worker();
+		for(std::thread &thread : threads)
+			thread.join();
+
+		int kept = 0;
+		keptRays.clear();
+		for(int i = 0; i < rays; i++)
+			if(hit[i] >= minDistance && hit[i] <= maxDistance)
+			{
+				cloud.points[kept++] = cloud.points[i];
+				keptRays.push_back(i);
+			}
+		cloud.points.resize(kept);
+		cloud.width = kept;
+		cloud.height = 1;
+	}
+};
+
+#endif /* RAY_CASTER_H */
@@ -0,0 +1,112 @@
+// Streams simulated scans of a Lidar profile to a binary pcd sequence, laid out like
+// sensors/data/pcd so the result plays back through streamPcd() and the frame pipeline
+
+#include "lidar.h"
+#include "../processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "../processPointClouds.cpp"
+#include "../pipeline/boundedQueue.h"
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// scans per second of the simulated sensor, cars move 1/SCAN_RATE seconds between frames
+#define SCAN_RATE 10
+// scans buffered while the writer catches up
+#define WRITE_QUEUE_SIZE 8
+
+
+// Cars on the highway of environment.cpp, driving along x at their own speed
+struct MovingCar
+{
+    Car car;
+    double speed;
+};
+
+
+std::vector<MovingCar> initTraffic()
+{
+    std::vector<MovingCar> traffic;
+    traffic.push_back({Car(Vect3(15,0,0), Vect3(4,2,2), Color(0,0,1), "car1"), 2.0});
+    traffic.push_back({Car(Vect3(8,-4,0), Vect3(4,2,2), Color(0,0,1), "car2"), -1.5});
+    traffic.push_back({Car(Vect3(-12,4,0), Vect3(4,2,2), Color(0,0,1), "car3"), 3.0});
+    traffic.push_back({Car(Vect3(30,4,0), Vect3(4,2,2), Color(0,0,1), "car4"), -4.0});
+    traffic.push_back({Car(Vect3(-25,-4,0), Vect3(4,2,2), Color(0,0,1), "car5"), 1.0});
+    return traffic;
+}
+
+
+int main(int argc, char** argv)
+{
+    if(argc < 4)
+    {
+        std::cerr << "usage: simulateLidar <profile> <frames> <outputDir> [profilesFile] [seed]" << std::endl;
+        return 1;
+    }
+    std::string profileName = argv[1];
+    int frames = atoi(argv[2]);
+    std::string outputDir = argv[3];
+    std::string profilesFile = (argc > 4) ? argv[4] : "../src/sensors/lidarProfiles.cfg";
+    // the same seed writes the same frames
+    uint64_t seed = (argc > 5) ? strtoull(argv[5], NULL, 10) : 0;
+
+    LidarProfile profile;
+    if(!loadLidarProfile(profilesFile, profileName, profile))
+        return 1;
+    boost::filesystem::create_directories(outputDir);
+
+    std::vector<MovingCar> traffic = initTraffic();
+    std::vector<Car> cars;
+    for(const MovingCar& moving : traffic)
+        cars.push_back(moving.car);
+    Lidar lidar(cars, 0, profile);
+    lidar.setSeed(seed);
+    std::cout << profile.name << ": " << profile.verticalAngles.size() << " beams, " << lidar.caster.numRays() << " rays per scan" << std::endl;
+
+    // Scans are written on their own thread so casting the next frame overlaps the disk
+    BoundedQueue<pcl::PointCloud<pcl::PointXYZI>::Ptr> writeQueue(WRITE_QUEUE_SIZE);
+    std::thread writer([&writeQueue, &outputDir]()
+    {
+        ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud;
+        for(int frame = 0; writeQueue.pop(cloud); frame++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "%010d.pcd", frame);
+            pointProcessor.savePcd(cloud, (boost::filesystem::path(outputDir) / name).string(), PcdBinary);
+        }
+    });
+
+    auto startTime = std::chrono::steady_clock::now();
+    long points = 0;
+    for(int frame = 0; frame < frames; frame++)
+    {
+        for(int c = 0; c < (int)traffic.size(); c++)
+            lidar.cars[c].position.x = traffic[c].car.position.x + traffic[c].speed*frame/SCAN_RATE;
+
+        pcl::PointCloud<pcl::PointXYZ>::Ptr scan = lidar.scan();
+
+        // the simulation has no reflectivity, intensity stays 0
+        pcl::PointCloud<pcl::PointXYZI>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZI>);
+        cloud->points.resize(scan->points.size());
+        for(int i = 0; i < (int)scan->points.size(); i++)
+        {
+            cloud->points[i].x = scan->points[i].x;
+            cloud->points[i].y = scan->points[i].y;
+            cloud->points[i].z = scan->points[i].z;
+            cloud->points[i].intensity = 0;
+        }
+        cloud->width = cloud->points.size();
+        cloud->height = 1;
+        points += cloud->points.size();
+        writeQueue.push(cloud);
+    }
+    writeQueue.close();
+    writer.join();
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << frames << " frames, " << (frames ? points/frames : 0) << " points/frame written to " << outputDir << " at "
+              << (elapsedMs > 0 ? 1000.0*frames/elapsedMs : 0) << " frames/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,313 @@
+// Multi object tracker over the boxes of consecutive frames.
+//
+// Every track runs the constant velocity Kalman filter of Part4's KalmanFilter/Tracking: state
+// (px, py, vx, vy), position measurements and acceleration noise noise_ax/noise_ay. With that model
+// and a block diagonal P the x and y axes never couple, so each track keeps two 2x2 covariances
+// and the filter is a handful of scalar operations instead of dynamically sized Eigen matrices.
+// Tracks live in a fixed size struct of arrays bank, predict runs as flat loops over it.
+//
+// Detections are associated by gated greedy nearest neighbour: pairs inside the Mahalanobis gate
+// of the predicted position are taken closest first. Candidates come from a uniform grid of
+// maxDistance cells, a track only looks at the detections of its own and the 8 neighbouring cells,
+// so an update costs O((tracks + detections) log detections). Unmatched detections start tentative
+// tracks, which are confirmed after confirmHits hits; tracks that miss more than maxMisses frames
+// in a row die.
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "../render/box.h"
+#include "../utils/profiler.h"
+
+// Tracks the bank holds at once, detections beyond it start no track
+#define TRACKER_CAPACITY 1024
+
+// One track as reported after an update
+struct TrackState
+{
+	int id;
+	float x, y, z;
+	float vx, vy;
+	float length, width, height;
+	int age;
+};
+
+class Tracker
+{
+public:
+
+	// acceleration noise, m/s^2 squared, as noise_ax/noise_ay of Part4's Tracking
+	float noiseAx;
+	float noiseAy;
+	// variance of a measured box center, m^2
+	float measurementVariance;
+	// squared Mahalanobis distance a detection may have from a prediction, 9.21 is chi2 99% for 2 dof
+	float gate;
+	// and its euclidean distance, m
+	float maxDistance;
+	int confirmHits;
+	int maxMisses;
+
+	Tracker()
+	: noiseAx(5), noiseAy(5), measurementVariance(0.0225), gate(9.21), maxDistance(3),
+	  confirmHits(3), maxMisses(3), numTracks(0), nextId(0)
+	{}
+
+	int size() const
+	{
+		return numTracks;
+	}
+
+	void clear()
+	{
+		numTracks = 0;
+	}
+
+	// Advance all tracks by dt seconds and correct them with the detections of the new frame
+	void update(const std::vector<BoxRecord> &detections, float dt)
+	{
+		PROFILE_SCOPE("Tracking");
+		predict(dt);
+		associate(detections);
+
+		for(int t = 0; t < numTracks; t++)
+		{
+			age[t]++;
+			if(assignment[t] < 0)
+			{
+				misses[t]++;
+				continue;
+			}
+			const BoxRecord &box = detections[assignment[t]];
+			correct(px[t], vx[t], pxx[t], pxv[t], pvv[t], box.x);
+			correct(py[t], vy[t], pyy[t], pyv[t], pvvy[t], box.y);
+			// the rest of the box is only smoothed
+			pz[t] += 0.5f*(box.z - pz[t]);
+			length[t] += 0.5f*(box.length - length[t]);
+			width[t] += 0.5f*(box.width - width[t]);
+			height[t] += 0.5f*(box.height - height[t]);
+			hits[t]++;
+			misses[t] = 0;
+		}
+
+		// Death: tentative tracks go at their first miss, confirmed ones at the first miss beyond maxMisses in a row
+		for(int t = 0; t < numTracks; )
+		{
+			bool confirmed = hits[t] >= confirmHits;
+			if(misses[t] > (confirmed ? maxMisses : 0))
+				removeTrack(t);
+			else
+				t++;
+		}
+
+		// Birth from every unmatched detection
+		for(int d = 0; d < (int)detections.size() && numTracks < TRACKER_CAPACITY; d++)
+			if(!matched[d])
+				addTrack(detections[d]);
+	}
+
+	// Confirmed tracks, the ones worth rendering
+	void confirmedTracks(std::vector<TrackState> &tracks) const
+	{
+		tracks.clear();
+		for(int t = 0; t < numTracks; t++)
+			if(hits[t] >= confirmHits)
+			{
+				TrackState track;
+				track.id = ids[t];
+				track.x = px[t];
+				track.y = py[t];
+				track.z = pz[t];
+				track.vx = vx[t];
+				track.vy = vy[t];
+				track.length = length[t];
+				track.width = width[t];
+				track.height = height[t];
+				track.age = age[t];
+				tracks.push_back(track);
+			}
+	}
+
+private:
+
+	void predict(float dt)
+	{
+		const float dt2 = dt*dt, dt3 = dt2*dt, dt4 = dt3*dt;
+		const float qxx = dt4/4*noiseAx, qxv = dt3/2*noiseAx, qvv = dt2*noiseAx;
+		const float qyy = dt4/4*noiseAy, qyv = dt3/2*noiseAy, qvvy = dt2*noiseAy;
+		// P = F P F^T + Q with F = [1 dt; 0 1] per axis
+		for(int t = 0; t < numTracks; t++)
+		{
+			px[t] += dt*vx[t];
+			pxx[t] += 2*dt*pxv[t] + dt2*pvv[t] + qxx;
+			pxv[t] += dt*pvv[t] + qxv;
+			pvv[t] += qvv;
+		}
+		for(int t = 0; t < numTracks; t++)
+		{
+			py[t] += dt*vy[t];
+			pyy[t] += 2*dt*pyv[t] + dt2*pvvy[t] + qyy;
+			pyv[t] += dt*pvvy[t] + qyv;
+			pvvy[t] += qvvy;
+		}
+	}
+
+	// Kalman update of one axis with H = [1 0]
+	void correct(float &p, float &v, float &cpp, float &cpv, float &cvv, float z) const
+	{
+		float s = cpp + measurementVariance;
+		float kp = cpp/s, kv = cpv/s;
+		float innovation = z - p;
+		p += kp*innovation;
+		v += kv*innovation;
+		cvv -= kv*cpv;
+		cpv *= 1 - kp;
+		cpp *= 1 - kp;
+	}
+
+	// Gated pairs closest first, each track and detection is used once
+	void associate(const std::vector<BoxRecord> &detections)
+	{
+		assignment.assign(numTracks, -1);
+		matched.assign(detections.size(), false);
+		pairs.clear();
+		const float maxDistanceSq = maxDistance*maxDistance;
+		const float inverseCell = 1/maxDistance;
+
+		// detections sorted by grid cell, a cell is one contiguous run
+		cells.clear();
+		for(int d = 0; d < (int)detections.size(); d++)
+			cells.push_back(CellEntry(cellKey(cellCoord(detections[d].x, inverseCell), cellCoord(detections[d].y, inverseCell)), d));
+		std::sort(cells.begin(), cells.end());
+
+		for(int t = 0; t < numTracks; t++)
+		{
+			float sx = 1/(pxx[t] + measurementVariance), sy = 1/(pyy[t] + measurementVariance);
+			int cx = cellCoord(px[t], inverseCell), cy = cellCoord(py[t], inverseCell);
+			for(int ix = cx - 1; ix <= cx + 1; ix++)
+				for(int iy = cy - 1; iy <= cy + 1; iy++)
+				{
+					std::vector<CellEntry>::const_iterator entry = std::lower_bound(cells.begin(), cells.end(), CellEntry(cellKey(ix, iy), -1));
+					for(uint64_t key = cellKey(ix, iy); entry != cells.end() && entry->key == key; ++entry)
+					{
+						int d = entry->detection;
+						float dx = detections[d].x - px[t], dy = detections[d].y - py[t];
+						if(dx*dx + dy*dy > maxDistanceSq)
+							continue;
+						float distance = dx*dx*sx + dy*dy*sy;
+						if(distance <= gate)
+							pairs.push_back(Pair(distance, t, d));
+					}
+				}
+		}
+
+		std::sort(pairs.begin(), pairs.end());
+		for(const Pair &pair : pairs)
+			if(assignment[pair.track] < 0 && !matched[pair.detection])
+			{
+				assignment[pair.track] = pair.detection;
+				matched[pair.detection] = true;
+			}
+	}
+
+	static int cellCoord(float value, float inverseCell)
+	{
+		return (int)floorf(value*inverseCell);
+	}
+
+	static uint64_t cellKey(int cx, int cy)
+	{
+		return (uint64_t)(uint32_t)cx << 32 | (uint32_t)cy;
+	}
+
+	void addTrack(const BoxRecord &box)
+	{
+		int t = numTracks++;
+		ids[t] = nextId++;
+		px[t] = box.x;
+		py[t] = box.y;
+		pz[t] = box.z;
+		vx[t] = vy[t] = 0;
+		// position as measured, velocity unknown like the P_ of Part4's Tracking
+		pxx[t] = pyy[t] = measurementVariance;
+		pxv[t] = pyv[t] = 0;
+		pvv[t] = pvvy[t] = 1000;
+		length[t] = box.length;
+		width[t] = box.width;
+		height[t] = box.height;
+		hits[t] = 1;
+		misses[t] = 0;
+		age[t] = 0;
+	}
+
+	// The last track takes the place of t so the bank stays dense
+	void removeTrack(int t)
+	{
+		int last = --numTracks;
+		ids[t] = ids[last];
+		px[t] = px[last]; py[t] = py[last]; pz[t] = pz[last];
+		vx[t] = vx[last]; vy[t] = vy[last];
+		pxx[t] = pxx[last]; pxv[t] = pxv[last]; pvv[t] = pvv[last];
+		pyy[t] = pyy[last]; pyv[t] = pyv[last]; pvvy[t] = pvvy[last];
+		length[t] = length[last]; width[t] = width[last]; height[t] = height[last];
+		hits[t] = hits[last]; misses[t] = misses[last]; age[t] = age[last];
+		assignment[t] = assignment[last];
+	}
+
+	struct Pair
+	{
+		float distance;
+		int track;
+		int detection;
+
+		Pair(float setDistance, int setTrack, int setDetection)
+		: distance(setDistance), track(setTrack), detection(setDetection)
+		{}
+
+		// ties go to the lower track and detection, the grid visits candidates in no useful order
+		bool operator<(const Pair &other) const
+		{
+			if(distance != other.distance)
+				return distance < other.distance;
+			return track < other.track || (track == other.track && detection < other.detection);
+		}
+	};
+
+	struct CellEntry
+	{
+		uint64_t key;
+		int detection;
+
+		CellEntry(uint64_t setKey, int setDetection)
+		: key(setKey), detection(setDetection)
+		{}
+
+		bool operator<(const CellEntry &other) const
+		{
+			return key < other.key || (key == other.key && detection < other.detection);
+		}
+	};
+
+	// track bank, tracks [0, numTracks) are alive
+	int ids[TRACKER_CAPACITY];
+	float px[TRACKER_CAPACITY], py[TRACKER_CAPACITY], pz[TRACKER_CAPACITY];
+	float vx[TRACKER_CAPACITY], vy[TRACKER_CAPACITY];
+	// covariance of (px, vx) and of (py, vy)
+	float pxx[TRACKER_CAPACITY], pxv[TRACKER_CAPACITY], pvv[TRACKER_CAPACITY];
+	float pyy[TRACKER_CAPACITY], pyv[TRACKER_CAPACITY], pvvy[TRACKER_CAPACITY];
+	float length[TRACKER_CAPACITY], width[TRACKER_CAPACITY], height[TRACKER_CAPACITY];
+	int hits[TRACKER_CAPACITY], misses[TRACKER_CAPACITY], age[TRACKER_CAPACITY];
+	int numTracks;
+	int nextId;
+	// update() scratch
+	std::vector<int> assignment;
+	std::vector<bool> matched;
+	std::vector<Pair> pairs;
+	std::vector<CellEntry> cells;
+};
+
+#endif /* TRACKER_H */
@@ -0,0 +1,167 @@
+// Global operator new and delete that count allocations per thread, see allocationCounter.h.
+// With glibc malloc and the aligned allocations are counted as well: the points of a pcl cloud
+// come from Eigen::aligned_allocator, which calls malloc or posix_memalign and never operator new.
+
+#include "allocationCounter.h"
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#ifdef __GLIBC__
+// The allocator the replaced functions below forward to
+extern "C"
+{
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void *memory, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *memory);
+}
+#endif
+
+namespace
+{
+
+void countAllocation(std::size_t size)
+{
+	AllocationCount &count = threadAllocations();
+	count.allocations++;
+	count.bytes += size;
+}
+
+void* uncountedMalloc(std::size_t size)
+{
+#ifdef __GLIBC__
+	return __libc_malloc(size);
+#else
+	return std::malloc(size);
+#endif
+}
+
+void* countedAllocate(std::size_t size)
+{
+	countAllocation(size);
+	if(size == 0)
+		size = 1;
+	while(true)
+	{
+		void *memory = uncountedMalloc(size);
+		if(memory)
+			return memory;
+		std::new_handler handler = std::get_new_handler();
+		if(!handler)
+			return NULL;
+		handler();
+	}
+}
+
+struct EnableCounting
+{
+	EnableCounting()
+	{
+		allocationCounting() = true;
+	}
+} enableCounting;
+
+}
+
+void* operator new(std::size_t size)
+{
+	void *memory = countedAllocate(size);
+	if(!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+
+#ifdef __GLIBC__
+
+extern "C"
+{
+
+void* malloc(std::size_t size)
+{
+	countAllocation(size);
+	return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size)
+{
+	countAllocation(count*size);
+	return __libc_calloc(count, size);
+}
+
+// Growing or moving a block is an allocation, freeing one through realloc(memory, 0) is not
+void* realloc(void *memory, std::size_t size)
+{
+	if(!memory || size > 0)
+		countAllocation(size);
+	return __libc_realloc(memory, size);
+}
+
+int posix_memalign(void **memory, std::size_t alignment, std::size_t size)
+{
+	if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	countAllocation(size);
+	void *aligned = __libc_memalign(alignment, size);
+	if(!aligned && size > 0)
+		return ENOMEM;
+	*memory = aligned;
+	return 0;
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+	countAllocation(size);
+	return __libc_memalign(alignment, size);
+}
+
+void* memalign(std::size_t alignment, std::size_t size)
+{
+	countAllocation(size);
+	return __libc_memalign(alignment, size);
+}
+
+void free(void *memory)
+{
+	__libc_free(memory);
+}
+
+}
+
+#endif
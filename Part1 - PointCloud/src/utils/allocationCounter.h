@@ -0,0 +1,64 @@
+// Heap allocation counting for the frame loop: allocationCounter.cpp replaces the global operator
+// new, and with glibc malloc and its aligned variants, and counts every call per thread, so a stage
+// can check that its steady state does not allocate.
+//
+// Targets that do not compile allocationCounter.cpp still build, the counts just stay 0 and
+// allocationCounting() returns false.
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include "profiler.h"
+
+struct AllocationCount
+{
+	long allocations;
+	long bytes;
+};
+
+// Allocations made so far by the calling thread
+inline AllocationCount& threadAllocations()
+{
+	static thread_local AllocationCount count = {0, 0};
+	return count;
+}
+
+// True when the counting operator new is linked in
+inline bool& allocationCounting()
+{
+	static bool counting = false;
+	return counting;
+}
+
+// Records the number of allocations the calling thread makes between construction and destruction
+class ScopedAllocationCount
+{
+public:
+
+	explicit ScopedAllocationCount(ProfileStat &setStat)
+	: stat(Profiler::instance().enabled() && allocationCounting() ? &setStat : NULL),
+	  startCount(threadAllocations().allocations)
+	{}
+
+	~ScopedAllocationCount()
+	{
+		if(stat)
+			stat->record(threadAllocations().allocations - startCount);
+	}
+
+private:
+
+	ProfileStat *stat;
+	long startCount;
+};
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_ALLOCATIONS(name)
+#else
+// Count the allocations of the rest of the enclosing scope under name
+#define PROFILE_ALLOCATIONS(name) \
+	static ProfileStat &PROFILE_CONCAT(allocationStat, __LINE__) = Profiler::instance().stat(name, "allocs"); \
+	ScopedAllocationCount PROFILE_CONCAT(allocationCount, __LINE__)(PROFILE_CONCAT(allocationStat, __LINE__))
+#endif
+
+#endif /* ALLOCATION_COUNTER_H */
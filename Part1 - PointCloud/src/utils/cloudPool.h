@@ -0,0 +1,73 @@
+// Pool of the point clouds a ProcessPointClouds hands out every frame. A cloud goes back to the
+// pool by itself once the frame drops its last reference, and keeps its capacity for the next
+// frame, so once the capacities have grown to the biggest frame the temporaries of a frame cost no
+// heap allocation.
+
+#ifndef CLOUD_POOL_H
+#define CLOUD_POOL_H
+
+#include <pcl/point_cloud.h>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+template<typename PointT>
+class CloudPool
+{
+public:
+
+	typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+
+	// Empty cloud nobody else references. Among the free clouds the smallest one holding
+	// expectedSize points is taken, or the biggest one, so the capacities settle on the frame sizes.
+	// 0 means the size is not known yet and always takes the biggest.
+	CloudPtr acquire(size_t expectedSize = 0)
+	{
+		if(expectedSize == 0)
+			expectedSize = std::numeric_limits<size_t>::max();
+		int best = -1;
+		for(int c = 0; c < (int)clouds.size(); c++)
+		{
+			if(clouds[c].use_count() != 1)
+				continue;
+			size_t capacity = clouds[c]->points.capacity();
+			if(best < 0)
+				best = c;
+			else
+			{
+				size_t bestCapacity = clouds[best]->points.capacity();
+				bool fits = capacity >= expectedSize, bestFits = bestCapacity >= expectedSize;
+				if((fits && (!bestFits || capacity < bestCapacity)) || (!fits && !bestFits && capacity > bestCapacity))
+					best = c;
+			}
+		}
+
+		if(best < 0)
+		{
+			clouds.push_back(CloudPtr(new pcl::PointCloud<PointT>));
+			best = clouds.size() - 1;
+		}
+		else
+			// the last reference may have been dropped by another pipeline stage
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+		CloudPtr cloud = clouds[best];
+		cloud->points.clear();
+		cloud->width = 0;
+		cloud->height = 1;
+		cloud->is_dense = true;
+		return cloud;
+	}
+
+	// Clouds created so far, stops growing once the pool is warm
+	int size() const
+	{
+		return clouds.size();
+	}
+
+private:
+
+	std::vector<CloudPtr> clouds;
+};
+
+#endif /* CLOUD_POOL_H */
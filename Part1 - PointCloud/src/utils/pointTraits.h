@@ -0,0 +1,27 @@
+// Access to the optional fields of a point type, so templated code handles
+// pcl::PointXYZ and pcl::PointXYZI alike
+
+#ifndef POINT_TRAITS_H
+#define POINT_TRAITS_H
+
+#include <pcl/point_types.h>
+
+template<typename PointT>
+struct PointTraits
+{
+	static const bool hasIntensity = false;
+
+	static float intensity(const PointT &) { return 0.0f; }
+	static void setIntensity(PointT &, float) {}
+};
+
+template<>
+struct PointTraits<pcl::PointXYZI>
+{
+	static const bool hasIntensity = true;
+
+	static float intensity(const pcl::PointXYZI &point) { return point.intensity; }
+	static void setIntensity(pcl::PointXYZI &point, float intensity) { point.intensity = intensity; }
+};
+
+#endif /* POINT_TRAITS_H */
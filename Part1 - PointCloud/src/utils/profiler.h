@@ -0,0 +1,343 @@
+// Shared instrumentation of the obstacle pipeline: scoped timers with microsecond resolution,
+// latency histograms and counters per name, a frame budget check and a JSON or CSV dump on exit.
+//
+// Everything is off until Profiler::instance().enable(true). Disabled, a PROFILE_SCOPE costs a
+// relaxed atomic load and a branch, and building with PROFILER_DISABLED defined removes the
+// macros altogether.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// Log-linear histogram of non negative integer values: exact below 16, then 16 buckets per
+// power of two, so a percentile is off by at most 1/16 of its value
+struct Histogram
+{
+	static const int NUM_BUCKETS = 16 + 60*16;
+
+	std::vector<long> buckets;
+	long count;
+	double sum;
+	int64_t max;
+
+	Histogram()
+	: buckets(NUM_BUCKETS, 0), count(0), sum(0), max(0)
+	{}
+
+	void add(int64_t value)
+	{
+		value = std::max<int64_t>(value, 0);
+		buckets[bucketOf(value)]++;
+		count++;
+		sum += value;
+		max = std::max(max, value);
+	}
+
+	double mean() const
+	{
+		return count ? sum/count : 0;
+	}
+
+	// Upper bound of the bucket holding the p-th fraction of the values, never above max
+	int64_t percentile(double p) const
+	{
+		if(count == 0)
+			return 0;
+		long rank = std::max(1L, (long)ceil(p*count));
+		long seen = 0;
+		for(int bucket = 0; bucket < NUM_BUCKETS; bucket++)
+		{
+			seen += buckets[bucket];
+			if(seen >= rank)
+				return std::min(upperBound(bucket), max);
+		}
+		return max;
+	}
+
+	static int bucketOf(int64_t value)
+	{
+		if(value < 16)
+			return value;
+		int exponent = 63 - __builtin_clzll(value);
+		int sub = (value >> (exponent - 4)) & 15;
+		return std::min(16 + (exponent - 4)*16 + sub, NUM_BUCKETS - 1);
+	}
+
+	static int64_t upperBound(int bucket)
+	{
+		if(bucket < 16)
+			return bucket;
+		int shift = (bucket - 16)/16;
+		int sub = (bucket - 16)%16;
+		return ((int64_t)(17 + sub) << shift) - 1;
+	}
+};
+
+// One named series, microseconds for timers and plain counts for counters
+struct ProfileStat
+{
+	std::string name;
+	std::string unit;
+	Histogram histogram;
+	std::mutex mutex;
+
+	void record(int64_t value)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		histogram.add(value);
+	}
+};
+
+class Profiler
+{
+public:
+
+	static Profiler& instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	bool enabled() const
+	{
+		return isEnabled.load(std::memory_order_relaxed);
+	}
+
+	void enable(bool enable)
+	{
+		isEnabled = enable;
+	}
+
+	// Frames slower than budgetMs are counted and reported, 0 turns the check off
+	void setFrameBudget(double budgetMs)
+	{
+		frameBudgetUs = budgetMs*1000;
+	}
+
+	// false only counts frames over the budget instead of also printing each one, for headless and batch runs
+	void setVerbose(bool setVerbose)
+	{
+		verbose = setVerbose;
+	}
+
+	// Series called name, created on first use. The reference stays valid for the whole run.
+	ProfileStat& stat(const std::string &name, const std::string &unit = "us")
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		for(const std::unique_ptr<ProfileStat> &stat : stats)
+			if(stat->name == name)
+				return *stat;
+		stats.push_back(std::unique_ptr<ProfileStat>(new ProfileStat));
+		stats.back()->name = name;
+		stats.back()->unit = unit;
+		return *stats.back();
+	}
+
+	// End to end time of a frame, recorded as "frame" and checked against the budget
+	void frameDone(long frameIndex, int64_t elapsedUs)
+	{
+		if(!enabled())
+			return;
+		static ProfileStat &frameStat = stat("frame");
+		frameStat.record(elapsedUs);
+		if(frameBudgetUs > 0 && elapsedUs > frameBudgetUs)
+		{
+			{
+				std::lock_guard<std::mutex> lock(statsMutex);
+				if(overBudgetFrames.size() < MAX_FLAGGED_FRAMES)
+					overBudgetFrames.push_back(frameIndex);
+				numOverBudget++;
+			}
+			// printed outside the lock so a slow terminal doesn't hold up the other workers
+			if(verbose)
+				std::cerr << "frame " << frameIndex << " took " << elapsedUs/1000.0 << " ms, over the "
+				          << frameBudgetUs/1000.0 << " ms budget" << std::endl;
+		}
+	}
+
+	// Table of every series with count, mean, p50/p95/p99 and max
+	void report(std::ostream &out)
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		std::streamsize precision = out.precision();
+		out << std::left << std::setw(28) << "name" << std::right << std::setw(6) << "unit" << std::setw(10) << "count"
+		    << std::setw(12) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99"
+		    << std::setw(10) << "max" << std::endl;
+		for(const std::unique_ptr<ProfileStat> &stat : stats)
+		{
+			std::lock_guard<std::mutex> statLock(stat->mutex);
+			const Histogram &h = stat->histogram;
+			out << std::left << std::setw(28) << stat->name << std::right << std::setw(6) << stat->unit << std::setw(10) << h.count
+			    << std::setw(12) << std::fixed << std::setprecision(1) << h.mean() << std::setw(10) << h.percentile(0.5)
+			    << std::setw(10) << h.percentile(0.95) << std::setw(10) << h.percentile(0.99) << std::setw(10) << h.max << std::endl;
+		}
+		out.unsetf(std::ios_base::floatfield);
+		out.precision(precision);
+		if(frameBudgetUs > 0)
+			out << numOverBudget << " frames over the " << frameBudgetUs/1000.0 << " ms budget" << std::endl;
+	}
+
+	// Every series as CSV when file ends with .csv, JSON otherwise
+	bool write(const std::string &file)
+	{
+		std::ofstream out(file.c_str());
+		if(!out)
+		{
+			std::cerr << "Couldn't write profile " << file << std::endl;
+			return false;
+		}
+		bool csv = file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0;
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		if(csv)
+			out << "name,unit,count,mean,p50,p95,p99,max" << std::endl;
+		else
+		{
+			out << "{\n  \"frameBudgetMs\": " << frameBudgetUs/1000.0 << ",\n  \"framesOverBudget\": " << numOverBudget
+			    << ",\n  \"overBudgetFrames\": [";
+			for(size_t i = 0; i < overBudgetFrames.size(); i++)
+				out << (i ? ", " : "") << overBudgetFrames[i];
+			out << "],\n  \"stats\": [";
+		}
+		for(size_t i = 0; i < stats.size(); i++)
+		{
+			std::lock_guard<std::mutex> statLock(stats[i]->mutex);
+			const Histogram &h = stats[i]->histogram;
+			if(csv)
+				out << stats[i]->name << "," << stats[i]->unit << "," << h.count << "," << h.mean() << "," << h.percentile(0.5) << ","
+				    << h.percentile(0.95) << "," << h.percentile(0.99) << "," << h.max << std::endl;
+			else
+				out << (i ? "," : "") << "\n    {\"name\": \"" << stats[i]->name << "\", \"unit\": \"" << stats[i]->unit << "\", \"count\": "
+				    << h.count << ", \"mean\": " << h.mean() << ", \"p50\": " << h.percentile(0.5) << ", \"p95\": " << h.percentile(0.95)
+				    << ", \"p99\": " << h.percentile(0.99) << ", \"max\": " << h.max << "}";
+		}
+		if(!csv)
+			out << "\n  ]\n}" << std::endl;
+		return true;
+	}
+
+	// Report to std::cout and write file when the program exits
+	void dumpOnExit(const std::string &file)
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+		bool registered = !dumpFile.empty();
+		dumpFile = file;
+		if(!registered)
+			std::atexit(&Profiler::dumpAtExit);
+	}
+
+private:
+
+	static const size_t MAX_FLAGGED_FRAMES = 1000;
+
+	Profiler()
+	: isEnabled(false), verbose(true), frameBudgetUs(0), numOverBudget(0)
+	{}
+
+	static void dumpAtExit()
+	{
+		Profiler &profiler = instance();
+		if(!profiler.enabled())
+			return;
+		profiler.report(std::cout);
+		profiler.write(profiler.dumpFile);
+	}
+
+	std::atomic<bool> isEnabled;
+	std::atomic<bool> verbose;
+	double frameBudgetUs;
+	long numOverBudget;
+	std::vector<long> overBudgetFrames;
+	std::vector<std::unique_ptr<ProfileStat> > stats;
+	std::mutex statsMutex;
+	std::string dumpFile;
+};
+
+// Records the microseconds between construction and destruction, nothing when the profiler is off
+class ScopedTimer
+{
+public:
+
+	explicit ScopedTimer(ProfileStat &setStat)
+	: stat(Profiler::instance().enabled() ? &setStat : NULL)
+	{
+		if(stat)
+			startTime = std::chrono::steady_clock::now();
+	}
+
+	~ScopedTimer()
+	{
+		if(stat)
+			stat->record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+	}
+
+private:
+
+	ProfileStat *stat;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+// Times a whole frame and hands it to Profiler::frameDone
+class FrameTimer
+{
+public:
+
+	explicit FrameTimer(long setFrameIndex)
+	: frameIndex(setFrameIndex), active(Profiler::instance().enabled())
+	{
+		if(active)
+			startTime = std::chrono::steady_clock::now();
+	}
+
+	~FrameTimer()
+	{
+		if(active)
+			Profiler::instance().frameDone(frameIndex, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+	}
+
+private:
+
+	long frameIndex;
+	bool active;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, value)
+#define PROFILE_FRAME(frameIndex)
+#else
+// Time the rest of the enclosing scope under name
+#define PROFILE_SCOPE(name) \
+	static ProfileStat &PROFILE_CONCAT(profileStat, __LINE__) = Profiler::instance().stat(name); \
+	ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(PROFILE_CONCAT(profileStat, __LINE__))
+// Add value to the counter series name
+#define PROFILE_COUNT(name, value) \
+	do { \
+		if(Profiler::instance().enabled()) \
+		{ \
+			static ProfileStat &profileCounter = Profiler::instance().stat(name, "count"); \
+			profileCounter.record(value); \
+		} \
+	} while(0)
+// Time the rest of the enclosing scope as frame frameIndex
+#define PROFILE_FRAME(frameIndex) FrameTimer PROFILE_CONCAT(frameTimer, __LINE__)(frameIndex)
+#endif
+
+#endif /* PROFILER_H */
@@ -0,0 +1,71 @@
+// Counter based random numbers for RANSAC, the Lidar simulator and the quizzes. Number n of
+// stream s under a seed is a pure function of (seed, s, n), so every thread, layer or hypothesis
+// takes a stream of its own: nothing is shared or locked, and a run is reproduced by its seed
+// whatever the number of threads and the order they run in.
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// splitmix64 output function, a bijection that spreads every input bit over the whole word
+inline uint64_t randomMix(uint64_t value)
+{
+	value += 0x9E3779B97F4A7C15ull;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}
+
+// One stream: a key made of seed and stream id, and a counter. Copying a stream copies its position,
+// nothing refers to global state like rand() does.
+class RandomStream
+{
+public:
+
+	explicit RandomStream(uint64_t seed = 0, uint64_t stream = 0)
+	: key(randomMix(seed ^ randomMix(stream))), counter(0)
+	{}
+
+	// Next 64 random bits, the splitmix64 sequence started at the key
+	uint64_t next()
+	{
+		return randomMix(key + counter++ * 0x9E3779B97F4A7C15ull);
+	}
+
+	// Uniform integer in [0, n) for n below 2^32, multiply and shift instead of a division
+	uint32_t below(uint32_t n)
+	{
+		return (uint32_t)(((next() >> 32) * n) >> 32);
+	}
+
+	// Uniform float in [0, 1) with 24 random bits
+	float uniform()
+	{
+		return (next() >> 40) * (1.0f / 16777216.0f);
+	}
+
+	// Uniform float in [low, high)
+	float uniform(float low, float high)
+	{
+		return low + (high - low) * uniform();
+	}
+
+	// Numbers drawn so far, seek() jumps to any of them in O(1)
+	uint64_t position() const
+	{
+		return counter;
+	}
+
+	void seek(uint64_t setCounter)
+	{
+		counter = setCounter;
+	}
+
+private:
+
+	uint64_t key;
+	uint64_t counter;
+};
+
+#endif /* RANDOM_H */
@@ -0,0 +1,277 @@
+// Structure of arrays point buffer: x, y, z and intensity each live in their own 64 byte aligned
+// column, so crop, plane distance and min/max loops run over packed floats instead of striding
+// over the padding of pcl points. Converted from and to pcl::PointCloud at the edges of a frame.
+
+#ifndef SOA_CLOUD_H
+#define SOA_CLOUD_H
+
+#include <pcl/point_cloud.h>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <vector>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "pointTraits.h"
+#include "../cluster/clusterSet.h"
+
+// Start of every column, a cache line and a whole AVX-512 register
+#define SOA_ALIGNMENT 64
+
+// Allocator handing out blocks aligned to Alignment bytes. Memory still comes from operator new,
+// the offset to the real block is stored in the bytes just before the aligned start.
+template<typename T, size_t Alignment>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() {}
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		char *block = (char*)::operator new(n*sizeof(T) + Alignment);
+		char *aligned = (char*)(((uintptr_t)block + Alignment) & ~(uintptr_t)(Alignment - 1));
+		((char**)aligned)[-1] = block;
+		return (T*)aligned;
+	}
+
+	void deallocate(T *memory, size_t)
+	{
+		::operator delete(((char**)memory)[-1]);
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+
+// Lowest and highest value of column[begin, end), min and max are only narrowed
+inline void columnMinMax(const float *column, int begin, int end, float &min, float &max)
+{
+	int i = begin;
+#if defined(__SSE2__)
+	if(end - begin >= 4)
+	{
+		__m128 low = _mm_set1_ps(min), high = _mm_set1_ps(max);
+		for(; i + 4 <= end; i += 4)
+		{
+			__m128 value = _mm_loadu_ps(column + i);
+			low = _mm_min_ps(low, value);
+			high = _mm_max_ps(high, value);
+		}
+		float lows[4], highs[4];
+		_mm_storeu_ps(lows, low);
+		_mm_storeu_ps(highs, high);
+		for(int lane = 0; lane < 4; lane++)
+		{
+			min = std::min(min, lows[lane]);
+			max = std::max(max, highs[lane]);
+		}
+	}
+#endif
+	for(; i < end; i++)
+	{
+		min = std::min(min, column[i]);
+		max = std::max(max, column[i]);
+	}
+}
+
+
+template<typename PointT>
+struct SoaCloud
+{
+	typedef std::vector<float, AlignedAllocator<float, SOA_ALIGNMENT> > Column;
+
+	Column x, y, z;
+	// only filled for point types with an intensity field
+	Column intensity;
+
+	static bool hasIntensity()
+	{
+		return PointTraits<PointT>::hasIntensity;
+	}
+
+	int size() const
+	{
+		return x.size();
+	}
+
+	bool empty() const
+	{
+		return x.empty();
+	}
+
+	// clear() and resize() keep the capacity of every column
+	void clear()
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+		intensity.clear();
+	}
+
+	void resize(int numPoints)
+	{
+		x.resize(numPoints);
+		y.resize(numPoints);
+		z.resize(numPoints);
+		if(hasIntensity())
+			intensity.resize(numPoints);
+	}
+
+	void reserve(int numPoints)
+	{
+		x.reserve(numPoints);
+		y.reserve(numPoints);
+		z.reserve(numPoints);
+		if(hasIntensity())
+			intensity.reserve(numPoints);
+	}
+
+	void push_back(float px, float py, float pz, float pi = 0)
+	{
+		x.push_back(px);
+		y.push_back(py);
+		z.push_back(pz);
+		if(hasIntensity())
+			intensity.push_back(pi);
+	}
+
+	PointT point(int i) const
+	{
+		PointT point;
+		point.x = x[i];
+		point.y = y[i];
+		point.z = z[i];
+		if(hasIntensity())
+			PointTraits<PointT>::setIntensity(point, intensity[i]);
+		return point;
+	}
+
+	void fromCloud(const pcl::PointCloud<PointT> &cloud)
+	{
+		int numPoints = cloud.points.size();
+		resize(numPoints);
+		for(int i = 0; i < numPoints; i++)
+		{
+			const PointT &point = cloud.points[i];
+			x[i] = point.x;
+			y[i] = point.y;
+			z[i] = point.z;
+			if(hasIntensity())
+				intensity[i] = PointTraits<PointT>::intensity(point);
+		}
+	}
+
+	void toCloud(pcl::PointCloud<PointT> &cloud) const
+	{
+		int numPoints = size();
+		cloud.points.resize(numPoints);
+		for(int i = 0; i < numPoints; i++)
+			cloud.points[i] = point(i);
+		cloud.width = numPoints;
+		cloud.height = 1;
+		cloud.is_dense = true;
+	}
+
+	// Append the points of source listed in indices[0, count)
+	void gather(const SoaCloud &source, const int *indices, int count)
+	{
+		int at = size();
+		resize(at + count);
+		for(int i = 0; i < count; i++)
+		{
+			x[at + i] = source.x[indices[i]];
+			y[at + i] = source.y[indices[i]];
+			z[at + i] = source.z[indices[i]];
+		}
+		if(hasIntensity())
+			for(int i = 0; i < count; i++)
+				intensity[at + i] = source.intensity[indices[i]];
+	}
+
+	// Append the points of source whose mask byte equals value, column by column
+	void select(const SoaCloud &source, const uint8_t *mask, uint8_t value)
+	{
+		int numPoints = source.size(), at = size(), count = 0;
+		for(int i = 0; i < numPoints; i++)
+			count += mask[i] == value;
+		if(count == 0)
+			return;
+		resize(at + count);
+		selectColumn(&source.x[0], mask, value, numPoints, &x[at]);
+		selectColumn(&source.y[0], mask, value, numPoints, &y[at]);
+		selectColumn(&source.z[0], mask, value, numPoints, &z[at]);
+		if(hasIntensity())
+			selectColumn(&source.intensity[0], mask, value, numPoints, &intensity[at]);
+	}
+
+private:
+
+	static void selectColumn(const float *column, const uint8_t *mask, uint8_t value, int numPoints, float *out)
+	{
+		for(int i = 0; i < numPoints; i++)
+			if(mask[i] == value)
+				*out++ = column[i];
+	}
+};
+
+
+// Clusters gathered back to back into SoA columns, cluster c is points[offsets[c], offsets[c+1])
+template<typename PointT>
+struct SoaClusterSet
+{
+	SoaCloud<PointT> points;
+	std::vector<int> offsets;
+
+	SoaClusterSet()
+	: offsets(1, 0)
+	{}
+
+	int size() const
+	{
+		return offsets.size() - 1;
+	}
+
+	int clusterSize(int cluster) const
+	{
+		return offsets[cluster+1] - offsets[cluster];
+	}
+
+	void clear()
+	{
+		points.clear();
+		offsets.assign(1, 0);
+	}
+
+	void add(const SoaCloud<PointT> &cloud, const int *indices, int count)
+	{
+		points.gather(cloud, indices, count);
+		offsets.push_back(points.size());
+	}
+
+	// Same clusters as an array of points ClusterSet, e.g. for rendering
+	void toClusterSet(ClusterSet<PointT> &clusters) const
+	{
+		clusters.points.resize(points.size());
+		for(int i = 0; i < points.size(); i++)
+			clusters.points[i] = points.point(i);
+		clusters.offsets = offsets;
+	}
+};
+
+#endif /* SOA_CLOUD_H */
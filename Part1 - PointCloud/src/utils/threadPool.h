@@ -0,0 +1,134 @@
+// Work stealing thread pool: every worker has its own task deque, takes its oldest task first
+// and steals the oldest task of another worker once its deque is empty. Tasks get the index of
+// the worker running them, so callers can keep scratch buffers per worker without locking.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+
+	typedef std::function<void(int worker)> Task;
+
+	explicit ThreadPool(int numThreads = std::thread::hardware_concurrency())
+	: queued(0), pending(0), nextWorker(0), stopping(false)
+	{
+		numThreads = std::max(numThreads, 1);
+		for(int w = 0; w < numThreads; w++)
+			workers.push_back(std::unique_ptr<Worker>(new Worker));
+		for(int w = 0; w < numThreads; w++)
+			threads.push_back(std::thread(&ThreadPool::run, this, w));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread &thread : threads)
+			thread.join();
+	}
+
+	int size() const
+	{
+		return workers.size();
+	}
+
+	// Tasks are dealt round robin, idle workers steal whatever is left
+	void submit(Task task)
+	{
+		pending++;
+		Worker &worker = *workers[nextWorker++ % workers.size()];
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			queued++;
+		}
+		wake.notify_one();
+	}
+
+	// Blocks until every submitted task has finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		idle.wait(lock, [this]{ return pending == 0; });
+	}
+
+private:
+
+	struct Worker
+	{
+		std::deque<Task> tasks;
+		std::mutex mutex;
+	};
+
+	bool popTask(int self, Task &task)
+	{
+		for(size_t i = 0; i < workers.size(); i++)
+		{
+			Worker &worker = *workers[(self + i) % workers.size()];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if(worker.tasks.empty())
+				continue;
+			// oldest first, own or stolen: FrameBatch consumes its frames in submission order
+			task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
+			queued--;
+			return true;
+		}
+		return false;
+	}
+
+	void run(int self)
+	{
+		Task task;
+		while(true)
+		{
+			if(popTask(self, task))
+			{
+				task(self);
+				task = Task();
+				if(--pending == 0)
+				{
+					std::lock_guard<std::mutex> lock(wakeMutex);
+					idle.notify_all();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [this]{ return stopping || queued > 0; });
+			if(stopping && queued == 0)
+				return;
+		}
+	}
+
+	std::vector<std::unique_ptr<Worker> > workers;
+	std::vector<std::thread> threads;
+	// tasks waiting in a deque, and tasks submitted but not finished
+	std::atomic<long> queued;
+	std::atomic<long> pending;
+	std::atomic<unsigned> nextWorker;
+	bool stopping;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+};
+
+#endif /* THREAD_POOL_H */